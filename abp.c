@@ -0,0 +1,36 @@
+#include <stddef.h>
+#include "emulator.h"
+#include "protocol.h"
+#include "arq.h"
+
+/* ******************************************************************
+   Alternating bit protocol.  Adapted from J.F.Kurose
+   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.2
+
+   Modifications:
+   - alternating bit is a policy of the sliding window engine in arq.c
+**********************************************************************/
+
+/* Alternating bit (stop and wait): one packet outstanding at a time,
+   resent on timeout until it is ACKed.  Sequence numbers still count
+   through the 32 bit space; with a window of one only their low bit
+   distinguishes a packet from the one before it.
+*/
+const struct arq_policy abp_policy = {
+  "abp", ACK_CUMULATIVE, RETRANSMIT_WINDOW, RECEIVE_DISCARD, 1, NULL
+};
+
+static void *abp_init(void)
+{
+  return(arq_create(&abp_policy));
+}
+
+const struct protocol abp_protocol = {
+  PROTOCOL_ABI_VERSION, "abp", abp_init, arq_output, arq_input, arq_timerinterrupt,
+  arq_input_batch
+};
+
+#ifdef PLUGIN
+/* the entry point the emulator looks up when this is built as a plugin */
+const struct protocol *protocol_plugin = &abp_protocol;
+#endif
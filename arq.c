@@ -0,0 +1,1536 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "emulator.h"
+#include "protocol.h"
+#include "arq.h"
+#include "checksum.h"
+#include "compress.h"
+#include "cc.h"
+#include "bitmap.h"
+#include "seqnum.h"
+#include "fec.h"
+#include "nagle.h"
+#include "stream.h"
+#include "deadline.h"
+#include "rack.h"
+#include "ring.h"
+
+/* Compile Command: gcc -Wall -ansi -pedantic -rdynamic -o emulator emulator.c arq.c gbn.c sr.c abp.c hybrid.c checksum.c compress.c fec.c nagle.c stream.c deadline.c rack.c cc.c bitmap.c ring.c -ldl
+   (see protocol.h for building a protocol as a plugin) */
+
+/* ******************************************************************
+   Sliding window ARQ engine.  Adapted from J.F.Kurose
+   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.2
+
+   The sender keeps up to windowsize unacked packets in a ring buffer
+   and runs a single timer for the window; the receiver delivers packets
+   to layer 5 in order.  How ACKs are generated and interpreted, what is
+   resent on a timeout and what the receiver does with packets that
+   arrive out of order are given by the protocol's struct arq_policy.
+
+   Modifications:
+   - merged the GBN (gbn.c) and SR (sr.c) implementations, which are
+   now policies of this engine, so all protocols link into one binary
+   - connection state is allocated per protocol instance and passed to
+   the protocol callbacks of protocol.h
+   - messages larger than the mtu are sent as several packets, all but
+   the last flagged PKT_MORE, and reassembled by the receiver.  The
+   sender takes a message only if all its packets fit in the window
+   - packets share the message's buffer (struct pktbuf) rather than
+   copying it: the sender holds a reference to each unacked packet's
+   buffer and the receiver to each packet it holds out of order
+   - packets that arrive at B together (gro=) are ACKed together: with
+   one cumulative ACK, or with selective ACKs whose payload carries the
+   further sequence numbers they acknowledge
+   - nagle= packs small messages into one packet (PKT_PACKED) while
+   earlier packets are in flight, for at most the given hold time; the
+   receiver unpacks them
+   - compress=rle compresses each message (compress.c) before it is
+   packed or fragmented, if that makes it smaller, and the receiver
+   expands it before layer 5
+   - fec=xor|rs adds forward error correction: after each block of
+   fecblock= (default 4) data packets the sender sends parity packets,
+   one (xor) or fecparity= (default 2, Reed-Solomon over GF(2^8), see
+   fec.c), which are not ACKed or resent.  The receiver keeps each
+   block's packets and rebuilds up to as many missing data packets as
+   parity packets arrived, without waiting for the sender to resend.
+   Data packets carry at most mtu - 4 bytes (mtu - 6 with streams=), as
+   the parity also codes their lengths and flags: with the default
+   mtu=20 a 20 byte message takes 2 packets, so raise mtu= by as much to
+   keep one packet per message.  Blocks are fecblock= consecutive
+   sequence numbers, the sender counting each packet's place in its
+   block; the last block before the sequence numbers wrap is cut short
+   unless fecblock= is a power of two
+   - deadline= gives messages a lifetime: packets of a message unacked
+   that long after it was sent are abandoned, not resent.  Data packets
+   carry the sender's window base (PKT_FORWARD) so the receiver stops
+   waiting for what was abandoned, and drops the rest of any message it
+   lost part of; a window that empties sends the signal on its own
+   - streams= multiplexes streams of messages (struct msg) over the one
+   window.  Each packet carries its stream and how far back the stream's
+   previous packet was sent, so a buffering receiver delivers a packet
+   ahead of the window once the one before it on its stream is delivered:
+   a loss only holds up its own stream.  Each stream reassembles its own
+   messages
+   - cc=aimd|cubic|model adds congestion control (cc.c): the sender keeps
+   at most min(cwnd, windowsize) packets in flight, the controller's
+   window being driven by ACKs, RTT samples of packets not resent, and
+   timeouts.  cc=bdp tunes the window to the bandwidth-delay product
+   measured from the ACKs instead, between minwindow= (default 1) and
+   windowsize=.  The sender reports its window to the emulator
+   - a policy may name a lossy policy (hybrid.c) that the sender switches
+   to while its timeouts per packet sent are above hybridloss= (default
+   0.05), and back once they fall below half of it.  Data packets carry
+   the sender's policy (PKT_SELECTIVE) so the receiver follows it, and
+   ACKs say whether they are selective
+   - pace= spreads the sender's packets out in time: new and resent
+   packets are sent one each 1 / pace time units, oldest first, rather
+   than in bursts, so they do not pile up in the link's queue.
+   pace=auto paces at the window (cwnd with cc=) over the smoothed RTT.
+   A's one timer then runs to the next packet's turn or the timeout,
+   whichever comes first
+   - RETRANSMIT_RECOVER (gbnb in gbn.c) goes back one packet at a time:
+   a timeout resends the oldest unacked packet, and each cumulative ACK
+   that then stops short of the packets sent before the timeout resends
+   the one it stops at, so a buffering receiver's held packets are not
+   sent again
+   - rack= detects losses by time, for selective ACKs: an ACK for a
+   packet sent more than rack= time units (the reordering window) after
+   an unacked one has it resent at once, without waiting for the
+   timeout.  With no ACK for TLP_GAIN smoothed RTTs the sender resends
+   the newest packet in flight as a tail loss probe, whose ACK shows the
+   losses before it.  The probe shares A's timer, as pacing does
+**********************************************************************/
+
+#define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
+#define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+
+#define PACE_AUTO (-1.0)   /* pace=auto: pace at the window over the smoothed RTT */
+#define PACE_GAIN 1.25     /* pace=auto: the rate over that, leaving room for the window to grow */
+
+#define HYBRID_SPAN 32.0   /* the timeouts and packets sent the loss is averaged over */
+
+
+/* sender (A) state */
+struct sender {
+  struct pkt *buffer;      /* ring of packets waiting for ACK */
+  unsigned long *acked;    /* bitmap of the ring slots acked out of order (selective ACKs) */
+  double *sendtime;        /* time each slot was last sent (per packet retransmission, cc=, pace=auto, rack=) */
+  unsigned long *resent;   /* cc=, pace=auto, rack=: bitmap of the ring slots resent, whose ACKs give no RTT sample */
+  struct cc cc;            /* congestion control, cc.algo NULL for none */
+  struct pkt *batch;       /* windowsize packets being sent together with tolayer3_batch() */
+  struct nagle nagle;      /* nagle=: messages packed for the next packet */
+  seq_t *streamlast;       /* streams=: the sequence number of each stream's last packet */
+  int windowfirst;         /* ring index of the first packet awaiting ACK */
+  int windowlast;          /* ring index of the last packet awaiting ACK */
+  int windowcount;         /* the number of packets currently awaiting an ACK */
+  seq_t nextseqnum;        /* the next sequence number to be used by the sender */
+  seq_t recover;           /* RETRANSMIT_RECOVER: the next sequence number at the last timeout */
+  bool recovering;         /* RETRANSMIT_RECOVER: packets before recover are still unacked */
+  const struct arq_policy *mode;  /* the policy recovering now: the protocol's, or its lossy one */
+  double loss;             /* lossy policy: timeouts per packet sent, a moving average */
+  unsigned long *queued;   /* pace=: bitmap of the ring slots waiting for their turn to be sent */
+  double nextsend;         /* pace=: the time the next of them may be sent */
+  double timeout;          /* pace=, rack=, nagle=: the time of the retransmission timeout, negative if not running */
+  double timerat;          /* pace=, rack=, nagle=: the time A's timer runs to, negative if not running */
+  struct rack rack;        /* rack=: time based loss detection and the tail loss probe */
+};
+
+/* receiver (B) state */
+struct receiver {
+  struct pkt *recv_buffer; /* packets that are out of order (buffering receiver) */
+  unsigned long *received; /* bitmap of the recv_buffer slots holding a packet */
+  unsigned long *ahead;    /* streams=: bitmap of those delivered ahead of the window */
+  struct stream *streams;  /* the messages being reassembled, by stream */
+  char *expanded;          /* a compressed message expanded */
+  int expandedsize;        /* bytes allocated for it */
+  struct msg *batch;       /* messages in order waiting for tolayer5_batch() */
+  int nbatch;              /* the number of them */
+  int maxbatch;            /* the most it holds */
+  seq_t *acks;             /* sequence numbers of a receive batch waiting for one selective ACK */
+  int nacks;               /* the number of them */
+  int maxacks;             /* the most one ACK carries: acknum and mtu / 4 in its payload */
+  char *ackpayload;        /* the payload of that ACK */
+  int windowfirst;         /* ring index of the next packet expected */
+  seq_t expectedseqnum;    /* the sequence number expected next by the receiver */
+  const struct arq_policy *mode;  /* the sender's policy, as the last data packet gave it */
+  int nextseqnum;          /* the sequence number for the next packets sent by B */
+};
+
+/* a connection between A and B */
+struct arq {
+  const struct arq_policy *policy;
+  double rtt;              /* the retransmission timeout (timeout=), RTT by default */
+  int windowsize;          /* the maximum number of buffered unacked packet */
+  int mtu;                 /* the largest payload of a packet */
+  int windowmask;          /* index mask of the window rings, a power of two of whole bitmap words */
+  bool compress;           /* compress messages */
+  int datasize;            /* the largest payload of a data packet: the mtu, less the fec= symbol header */
+  struct deadline deadline;  /* deadline=: when each slot's message is abandoned, lifetime 0 for never */
+  int nstreams;            /* the number of streams of messages */
+  const struct ccalgo *ccalgo;  /* the congestion controller, NULL for none */
+  int minwindow;           /* the least window it cuts to */
+  double hybridloss;       /* timeouts per packet sent above which the lossy policy is used */
+  double pace;             /* packets sent per time unit, 0 for as soon as they may be, or PACE_AUTO */
+  struct fec fec;          /* forward error correction, fec.mode FEC_NONE for none */
+  struct sender sender;
+  struct receiver receiver;
+};
+
+
+/* sequence numbers in a payload are 4 bytes, least significant first */
+static seq_t getseqnum(const char *p)
+{
+  const unsigned char *u = (const unsigned char *)p;
+
+  return((seq_t)u[0] | (seq_t)u[1] << 8 | (seq_t)u[2] << 16 | (seq_t)u[3] << 24);
+}
+
+static void putseqnum(char *p, seq_t seqnum)
+{
+  int i;
+
+  for (i=0; i<4; i++)
+    p[i] = (char)((seqnum >> (8 * i)) & 0xFF);
+}
+
+static void *allocate(size_t size)
+{
+  void *p = malloc(size);
+
+  if (p == NULL) {
+    printf("memory allocation for connection failed.\n");
+    exit(EXIT_FAILURE);
+  }
+  return(p);
+}
+
+/* set up a connection between A and B running policy.  This is the init
+   callback of every protocol built on the engine */
+void *arq_create(const struct arq_policy *policy)
+{
+  struct arq *c = allocate(sizeof(struct arq));
+  int slots;
+  int fecmode, feck, fecm, fechdr;
+  double hold, lifetime, rack;
+  int i;
+
+  c->policy = policy;
+
+  /* read the protocol parameters, defaulting to the assignment values */
+  c->windowsize = getintoption("windowsize", c->policy->maxwindow < 6 ? c->policy->maxwindow : 6);
+  c->rtt = getoption("timeout", RTT);
+  c->mtu = getintoption("mtu", 20);
+  hold = getoption("nagle", 0);
+  c->compress = strcmp(getstringoption("compress", "none"), "rle") == 0;
+  if (!c->compress && strcmp(getstringoption("compress", "none"), "none") != 0) {
+    printf("compress must be none or rle\n");
+    exit(EXIT_FAILURE);
+  }
+  if (strcmp(getstringoption("fec", "none"), "none") == 0)
+    fecmode = FEC_NONE;
+  else if (strcmp(getstringoption("fec", "none"), "xor") == 0)
+    fecmode = FEC_XOR;
+  else if (strcmp(getstringoption("fec", "none"), "rs") == 0)
+    fecmode = FEC_RS;
+  else {
+    printf("fec must be none, xor or rs\n");
+    exit(EXIT_FAILURE);
+  }
+  feck = getintoption("fecblock", 4);
+  fecm = fecmode == FEC_XOR ? 1 : getintoption("fecparity", 2);
+  lifetime = getoption("deadline", 0);
+  c->nstreams = getintoption("streams", 1);
+  c->ccalgo = cc_find(getstringoption("cc", "none"));
+  if (c->ccalgo == NULL && strcmp(getstringoption("cc", "none"), "none") != 0) {
+    printf("cc must be none, aimd, cubic, model or bdp\n");
+    exit(EXIT_FAILURE);
+  }
+  c->minwindow = getintoption("minwindow", 1);
+  c->hybridloss = getoption("hybridloss", 0.05);
+  c->pace = strcmp(getstringoption("pace", "0"), "auto") == 0 ? PACE_AUTO : getoption("pace", 0);
+  if (c->pace < 0.0 && c->pace != PACE_AUTO) {
+    printf("pace must be a rate >= 0 or auto\n");
+    exit(EXIT_FAILURE);
+  }
+  rack = getoption("rack", 0);
+  if (rack < 0.0 || (rack > 0.0 && c->policy->ack != ACK_SELECTIVE &&
+                        (c->policy->lossy == NULL || c->policy->lossy->ack != ACK_SELECTIVE))) {
+    printf("rack must be >= 0, and needs selective ACKs (sr, srt or hybrid)\n");
+    exit(EXIT_FAILURE);
+  }
+  fechdr = c->nstreams > 1 ? FECHDR + 2 : FECHDR;
+  c->datasize = c->mtu;
+  if (fecmode != FEC_NONE) {
+    if (feck < 1 || fecm < 1 || feck + fecm > 255 || c->mtu <= fechdr || c->mtu > fechdr + 0xFFFF) {
+      printf("fec needs fecblock >= 1, fecparity >= 1, fecblock + fecparity <= 255 and %d < mtu <= %d\n",
+             fechdr, fechdr + 0xFFFF);
+      exit(EXIT_FAILURE);
+    }
+    c->datasize = c->mtu - fechdr;
+  }
+  /* the window's ring must also fit in an int */
+  if (c->windowsize < 1 || c->windowsize > c->policy->maxwindow || c->windowsize > RING_MAXSIZE || c->rtt <= 0.0) {
+    printf("%s needs 1 <= windowsize <= %d and timeout > 0\n", c->policy->name,
+           c->policy->maxwindow < RING_MAXSIZE ? c->policy->maxwindow : RING_MAXSIZE);
+    exit(EXIT_FAILURE);
+  }
+  if (hold < 0.0 || lifetime < 0.0 || c->hybridloss < 0.0) {
+    printf("nagle, deadline and hybridloss must be >= 0\n");
+    exit(EXIT_FAILURE);
+  }
+  if (c->minwindow < 1 || c->minwindow > c->windowsize) {
+    printf("minwindow must be 1 to windowsize\n");
+    exit(EXIT_FAILURE);
+  }
+  if (c->nstreams < 1 || c->nstreams > MAXSTREAMS ||
+      (c->nstreams > 1 && c->windowsize > PKT_PREV >> PKT_PREVSHIFT)) {
+    printf("streams needs 1 <= streams <= %d, and windowsize <= %d with more than one\n",
+           MAXSTREAMS, PKT_PREV >> PKT_PREVSHIFT);
+    exit(EXIT_FAILURE);
+  }
+  if (!SelectChecksum(getstringoption("checksum", "sum"))) {
+    printf("unknown checksum %s, expected sum, inet or crc32c\n", getstringoption("checksum", "sum"));
+    exit(EXIT_FAILURE);
+  }
+
+  slots =ring_size(bitmap_roundup(c->windowsize));
+  c->windowmask = slots - 1;
+
+  c->sender.buffer = allocate(slots * sizeof(struct pkt));
+  c->sender.acked = bitmap_alloc(slots);
+  c->sender.batch = allocate(c->windowsize * sizeof(struct pkt));
+  c->sender.sendtime = NULL;
+  if (c->policy->retransmit == RETRANSMIT_EACH || c->ccalgo != NULL || c->pace == PACE_AUTO || rack > 0.0 ||
+      (c->policy->lossy != NULL && c->policy->lossy->retransmit == RETRANSMIT_EACH))
+    c->sender.sendtime = allocate(slots * sizeof(double));
+  c->sender.resent = NULL;
+  if (c->ccalgo != NULL || c->pace == PACE_AUTO || rack > 0.0)
+    c->sender.resent = bitmap_alloc(slots);
+  cc_init(&c->sender.cc, c->ccalgo, c->minwindow, c->windowsize, c->rtt);
+  if (c->ccalgo != NULL)
+    send_window = cc_window(&c->sender.cc);
+  deadline_init(&c->deadline, lifetime, slots);
+  c->sender.nextseqnum = 0;  /* A starts with seq num 0, do not change this */
+  c->sender.windowfirst = 0;
+  c->sender.windowlast = -1; /* windowlast is where the last packet sent is stored.
+		           new packets are placed in winlast + 1
+		           so initially this is set to -1
+		         */
+  c->sender.windowcount = 0;
+  c->sender.recovering = false;
+  c->sender.mode = c->policy;
+  c->sender.loss = 0.0;
+  c->sender.queued = bitmap_alloc(slots);
+  c->sender.nextsend = 0.0;
+  c->sender.timeout = -1.0;
+  c->sender.timerat = -1.0;
+  rack_init(&c->sender.rack, rack);
+  nagle_init(&c->sender.nagle, hold, c->datasize);
+  c->sender.streamlast = allocate(c->nstreams * sizeof(seq_t));
+  fec_init(&c->fec, fecmode, feck, fecm, c->mtu, fechdr, c->windowsize);
+
+  c->receiver.recv_buffer = NULL;
+  if (c->policy->receive == RECEIVE_BUFFER || (c->policy->lossy != NULL && c->policy->lossy->receive == RECEIVE_BUFFER))
+    c->receiver.recv_buffer = allocate(slots * sizeof(struct pkt));
+  c->receiver.received = bitmap_alloc(slots);
+  c->receiver.ahead = bitmap_alloc(slots);
+  c->receiver.streams = allocate(c->nstreams * sizeof(struct stream));
+  for (i=0; i<c->nstreams; i++) {
+    c->sender.streamlast[i] = 0;
+    stream_init(&c->receiver.streams[i], c->mtu);
+  }
+  c->receiver.expandedsize = c->mtu;
+  c->receiver.expanded = allocate(c->receiver.expandedsize);
+  c->receiver.maxbatch = c->windowsize + 1;
+  c->receiver.batch = allocate(c->receiver.maxbatch * sizeof(struct msg));
+  c->receiver.nbatch = 0;
+  c->receiver.maxacks = 1 + c->mtu / 4;
+  c->receiver.acks = allocate(c->receiver.maxacks * sizeof(seq_t));
+  c->receiver.ackpayload = allocate(c->mtu);
+  c->receiver.nacks = 0;
+  c->receiver.windowfirst = 0;
+  c->receiver.expectedseqnum = 0;
+  c->receiver.mode = c->policy;
+  c->receiver.nextseqnum = 1;
+  return(c);
+}
+
+
+/********* Sender (A) functions ************/
+
+/* send the parity packets queued, after the data packets they cover */
+static void sender_sendparity(struct arq *c)
+{
+  struct fec *f = &c->fec;
+
+  if (f->nparity == 0)
+    return;
+  if (TRACE > 0)
+    printf("Sending %d parity packets to layer 3\n", f->nparity);
+  tolayer3_batch(A, f->paritybatch, f->nparity);
+  parity_sent += f->nparity;
+  fec_sent(f);
+}
+
+
+/********* Window and pacing ************/
+
+/* the number of packets the sender may have in flight */
+static int sender_window(struct arq *c)
+{
+  if (c->sender.cc.algo != NULL)
+    return(cc_window(&c->sender.cc));
+  return(c->windowsize);
+}
+
+/* tell the emulator the window, when congestion control changes it */
+static void sender_reportwindow(struct arq *c)
+{
+  if (c->sender.cc.algo != NULL)
+    send_window = sender_window(c);
+}
+
+/* the window offset of the oldest packet waiting for its turn, or -1 */
+static int sender_nextqueued(struct arq *c)
+{
+  struct sender *s = &c->sender;
+  int i, slot;
+
+  for (i=0; i<s->windowcount; i++) {
+    slot = ring_slot(s->windowfirst, i, c->windowmask);
+    if (bitmap_test(s->queued, slot) && !bitmap_test(s->acked, slot))
+      return(i);
+  }
+  return(-1);
+}
+
+/* run A's timer to the next packet's turn, the tail loss probe, the end
+   of the packed messages' hold or the timeout, whichever is first */
+static void sender_armtimer(struct arq *c)
+{
+  struct sender *s = &c->sender;
+  double now, at, held;
+
+  at = s->timeout;
+  if (s->rack.probe >= 0.0 && (at < 0.0 || s->rack.probe < at))
+    at = s->rack.probe;
+  held = nagle_deadline(&s->nagle);
+  if (held >= 0.0 && (at < 0.0 || held < at))
+    at = held;
+  if (sender_nextqueued(c) >= 0 && (at < 0.0 || s->nextsend < at))
+    at = s->nextsend;
+  if (at == s->timerat)
+    return;
+  if (s->timerat >= 0.0)
+    stoptimer(A);
+  s->timerat = at;
+  now = gettime();
+  if (at >= 0.0)
+    starttimer(A, at > now ? at - now : 0.0);
+}
+
+/* send the packets whose turn has come, one each 1 / rate time units */
+static void sender_pace(struct arq *c)
+{
+  struct sender *s = &c->sender;
+  double now, rate;
+  int offset, slot;
+
+  now = gettime();
+  while ((float)s->nextsend <= (float)now && (offset = sender_nextqueued(c)) >= 0) {
+    slot = ring_slot(s->windowfirst, offset, c->windowmask);
+    bitmap_clear(s->queued, slot);
+    if (s->sendtime != NULL)
+      s->sendtime[slot] = now;
+    tolayer3(A, s->buffer[slot]);
+    rate = c->pace == PACE_AUTO ? PACE_GAIN * sender_window(c) / s->cc.srtt : c->pace;
+    s->nextsend = (s->nextsend > now ? s->nextsend : now) + 1.0 / rate;
+  }
+  sender_armtimer(c);
+}
+
+/* send packets of the window, or with pace= leave them to be sent in turn */
+static void sender_transmit(struct arq *c, struct pkt packets[], int n)
+{
+  struct sender *s = &c->sender;
+  seq_t seqfirst;
+  int i;
+
+  if (c->pace == 0.0) {
+    tolayer3_batch(A, packets, n);
+    return;
+  }
+  seqfirst = seq_sub(s->nextseqnum, s->windowcount);
+  for (i=0; i<n; i++)
+    bitmap_set(s->queued, ring_slot(s->windowfirst, seq_diff(packets[i].seqnum, seqfirst), c->windowmask));
+  sender_pace(c);
+}
+
+/* whether A's timer is shared by the retransmission timeout with the
+   pacing (pace=), the tail loss probe (rack=) or the hold of packed
+   messages (nagle=) */
+static bool sender_sharedtimer(struct arq *c)
+{
+  return(c->pace != 0.0 || c->sender.rack.window > 0.0 || c->sender.nagle.hold > 0.0);
+}
+
+/* A's retransmission timer, which may share A's timer */
+static void sender_starttimer(struct arq *c, double increment)
+{
+  if (!sender_sharedtimer(c)) {
+    starttimer(A, increment);
+    return;
+  }
+  c->sender.timeout = gettime() + increment;
+  sender_armtimer(c);
+}
+
+static void sender_stoptimer(struct arq *c)
+{
+  if (!sender_sharedtimer(c)) {
+    stoptimer(A);
+    return;
+  }
+  c->sender.timeout = -1.0;
+  sender_armtimer(c);
+}
+
+
+/* start A's timer for the packets in the window, if there are any */
+static void startwindowtimer(struct arq *c)
+{
+  double now, deadline;
+  int i, slot;
+
+  if (c->sender.windowcount == 0)
+    return;
+  if (c->sender.mode->retransmit != RETRANSMIT_EACH) {
+    sender_starttimer(c, c->rtt);
+    return;
+  }
+
+  /* per packet timeouts: run the timer to the earliest unacked packet's
+     timeout.  Packets waiting for their turn (pace=) are not timed yet */
+  now = gettime();
+  deadline = now + c->rtt;
+  for (i=0; i<c->sender.windowcount; i++) {
+    slot = ring_slot(c->sender.windowfirst, i, c->windowmask);
+    if (!bitmap_test(c->sender.acked, slot) && !bitmap_test(c->sender.queued, slot) &&
+        c->sender.sendtime[slot] + c->rtt < deadline)
+      deadline = c->sender.sendtime[slot] + c->rtt;
+  }
+  sender_starttimer(c, deadline > now ? deadline - now : 0.0);
+}
+
+/* a packet of the window to send again, with deadline= telling the
+   receiver the window base as it is now, and a hybrid the policy.  With
+   cc= it is a loss, unless it is only a probe */
+static struct pkt *sender_resend(struct arq *c, int slot, bool loss)
+{
+  struct sender *s = &c->sender;
+  struct pkt *packet = &s->buffer[slot];
+
+  if (c->deadline.lifetime > 0.0)
+    packet->acknum = (int)seq_sub(s->nextseqnum, s->windowcount);
+  if (c->policy->lossy != NULL)
+    packet->flags = s->mode == c->policy ? packet->flags & ~PKT_SELECTIVE : packet->flags | PKT_SELECTIVE;
+  if (c->deadline.lifetime > 0.0 || c->policy->lossy != NULL)
+    packet->checksum = ComputeChecksum(*packet);
+  if (s->sendtime != NULL)
+    s->sendtime[slot] = gettime();
+  if (s->resent != NULL) {
+    bitmap_set(s->resent, slot);
+    if (loss) {
+      cc_loss(&s->cc, gettime());
+      sender_reportwindow(c);
+    }
+  }
+  packets_resent++;
+  return(packet);
+}
+
+/* with deadline=, abandon the packets at the window base whose message
+   has expired, returning how many.  Later messages were sent later, so
+   they expire later.  If the window empties the receiver is told at
+   once, as no data packet will carry the news */
+static int sender_expire(struct arq *c)
+{
+  struct sender *s = &c->sender;
+  struct pkt sendpkt;
+  double now;
+  int n = 0;
+  int i;
+
+  if (c->deadline.lifetime <= 0.0)
+    return(0);
+  now = gettime();
+  while (s->windowcount > 0 && deadline_expired(&c->deadline, s->windowfirst, now)) {
+    if (TRACE > 0)
+      printf("----A: packet %d expired, abandoned\n", s->buffer[s->windowfirst].seqnum);
+    pktbuf_release(s->buffer[s->windowfirst].buf);
+    s->windowfirst = ring_slot(s->windowfirst, 1, c->windowmask);
+    s->windowcount--;
+    packets_abandoned++;
+    n++;
+
+    /* packets acked out of order behind it are done with too */
+    for (i=bitmap_takerun(s->acked, c->windowmask + 1, s->windowfirst, s->windowcount); i>0; i--) {
+      pktbuf_release(s->buffer[s->windowfirst].buf);
+      s->windowfirst = ring_slot(s->windowfirst, 1, c->windowmask);
+      s->windowcount--;
+      n++;
+    }
+  }
+  if (n > 0 && s->windowcount == 0) {
+    sendpkt.seqnum = NOTINUSE;
+    sendpkt.acknum = (int)s->nextseqnum;
+    sendpkt.flags = PKT_FORWARD | PKT_CONTROL;
+    sendpkt.length = 0;
+    sendpkt.payload = NULL;
+    sendpkt.buf = NULL;
+    sendpkt.checksum = ComputeChecksum(sendpkt);
+    tolayer3(A, sendpkt);
+  }
+  return(n);
+}
+
+/* with a lossy policy, count a timeout or a new packet sent into the
+   loss, and switch policy if it crossed hybridloss= or half of it */
+static void sender_adapt(struct arq *c, bool timeout)
+{
+  struct sender *s = &c->sender;
+  const struct arq_policy *mode = s->mode;
+
+  if (c->policy->lossy == NULL)
+    return;
+  s->loss += ((timeout ? 1.0 : 0.0) - s->loss) / HYBRID_SPAN;
+  if (s->loss > c->hybridloss)
+    mode = c->policy->lossy;
+  else if (s->loss < c->hybridloss / 2.0)
+    mode = c->policy;
+  if (mode != s->mode) {
+    if (TRACE > 0)
+      printf("----A: %.3f timeouts per packet, switching to %s recovery\n", s->loss,
+             mode->ack == ACK_SELECTIVE ? "selective" : "go back N");
+    s->mode = mode;
+    policy_switches++;
+  }
+}
+
+/* rack=: run the tail loss probe while selectively acked packets are in
+   flight */
+static void sender_armprobe(struct arq *c)
+{
+  struct sender *s = &c->sender;
+
+  if (s->rack.window <= 0.0)
+    return;
+  rack_arm(&s->rack, s->windowcount > 0 && s->mode->ack == ACK_SELECTIVE, gettime(), s->cc.srtt);
+  sender_armtimer(c);
+}
+
+/* rack=: when the probe is due, resend the newest packet in flight, so
+   that its ACK shows which packets before it were lost */
+static void sender_probe(struct arq *c)
+{
+  struct sender *s = &c->sender;
+  int i, slot;
+
+  if (!rack_due(&s->rack, gettime()))
+    return;
+  for (i=s->windowcount-1; i>=0; i--) {
+    slot = ring_slot(s->windowfirst, i, c->windowmask);
+    if (!bitmap_test(s->acked, slot) && !bitmap_test(s->queued, slot)) {
+      if (TRACE > 0)
+        printf("---A: no ACK, probing with packet %d\n", s->buffer[slot].seqnum);
+      tail_probes++;
+      s->rack.probeslot = slot;
+      sender_transmit(c, sender_resend(c, slot, false), 1);
+      return;
+    }
+  }
+}
+
+/* rack=: resend at once the unacked packets sent more than the reordering
+   window before the latest packet acked was sent: in order, their ACKs
+   would have come first */
+static void sender_detect(struct arq *c)
+{
+  struct sender *s = &c->sender;
+  bool oldest = false;
+  int nbatch = 0;
+  int i, slot;
+
+  if (s->rack.window <= 0.0)
+    return;
+  for (i=0; i<s->windowcount; i++) {
+    slot = ring_slot(s->windowfirst, i, c->windowmask);
+    if (bitmap_test(s->acked, slot) || bitmap_test(s->queued, slot) || !rack_lost(&s->rack, s->sendtime[slot]))
+      continue;
+    if (TRACE > 0)
+      printf("---A: packet %d lost, resending\n", s->buffer[slot].seqnum);
+    if (i == 0)
+      oldest = true;
+    packets_detected++;
+    s->batch[nbatch++] = *sender_resend(c, slot, true);
+  }
+  sender_transmit(c, s->batch, nbatch);
+
+  /* the oldest resent times out from now */
+  if (oldest) {
+    sender_stoptimer(c);
+    startwindowtimer(c);
+  }
+}
+
+/* put a new packet of flags, length and payload in buf into the window,
+   and return it for sending.  PKT_FIRST is only sent with deadline= */
+static struct pkt *sender_queue(struct arq *c, int flags, int length, char *payload, struct pktbuf *buf)
+{
+  struct sender *s = &c->sender;
+  struct pkt *sendpkt;
+
+  /* point back to the stream's packet before, while it is unacked */
+  if (c->nstreams > 1)
+    flags |= stream_prev(&s->streamlast[(flags & PKT_STREAM) >> PKT_STREAMSHIFT], s->nextseqnum,
+                         seq_sub(s->nextseqnum, s->windowcount)) << PKT_PREVSHIFT;
+
+  /* a hybrid tells the receiver which policy it is using */
+  sender_adapt(c, false);
+  if (s->mode != c->policy)
+    flags |= PKT_SELECTIVE;
+
+  /* create packet in the window buffer */
+  s->windowlast = ring_slot(s->windowlast, 1, c->windowmask);
+  sendpkt = &s->buffer[s->windowlast];
+  sendpkt->seqnum = (int)s->nextseqnum;
+  sendpkt->acknum = NOTINUSE;
+  sendpkt->flags = flags & ~PKT_FIRST;
+  if (c->deadline.lifetime > 0.0) {
+    /* tell the receiver not to wait for the packets before the window */
+    sendpkt->acknum = (int)seq_sub(s->nextseqnum, s->windowcount);
+    sendpkt->flags = flags | PKT_FORWARD;
+    deadline_start(&c->deadline, s->windowlast, gettime());
+  }
+  sendpkt->length = length;
+  sendpkt->payload = payload;   /* NULL: synthetic */
+  sendpkt->buf = pktbuf_hold(buf);
+  sendpkt->checksum = ComputeChecksum(*sendpkt);
+
+  bitmap_clear(s->acked, s->windowlast);
+  bitmap_clear(s->queued, s->windowlast);
+  rack_reuse(&s->rack, s->windowlast);
+  if (s->sendtime != NULL)
+    s->sendtime[s->windowlast] = gettime();
+  if (s->resent != NULL)
+    bitmap_clear(s->resent, s->windowlast);
+  s->windowcount++;
+  if (TRACE > 0)
+    printf("Sending packet %d to layer 3\n", sendpkt->seqnum);
+  if (c->fec.mode != FEC_NONE)
+    fec_encode(&c->fec, sendpkt);
+
+  /* start timer if first packet in window */
+  if (s->windowcount == 1)
+    sender_starttimer(c, c->rtt);
+  sender_armprobe(c);
+
+  /* get next sequence number, wrap back to 0 */
+  s->nextseqnum = seq_add(s->nextseqnum, 1);
+  return(sendpkt);
+}
+
+/* send the packet of packed messages, whose window slot was kept for it */
+static void sender_sendpending(struct arq *c)
+{
+  struct sender *s = &c->sender;
+  struct pkt *sendpkt;
+
+  if (s->nagle.pending == NULL)
+    return;
+  sendpkt = sender_queue(c, PKT_PACKED | PKT_FIRST | s->nagle.stream << PKT_STREAMSHIFT,
+                         s->nagle.length, s->nagle.pending->data, s->nagle.pending);
+  if (c->deadline.lifetime > 0.0)
+    deadline_start(&c->deadline, s->windowlast, s->nagle.since);
+  sender_transmit(c, sendpkt, 1);
+  sender_sendparity(c);
+  pktbuf_release(nagle_take(&s->nagle));
+}
+
+/* Nagle: packed messages wait for more only while there are packets in
+   flight, and for at most the hold time, to whose end A's timer runs */
+static void sender_checkpending(struct arq *c)
+{
+  struct sender *s = &c->sender;
+
+  if (s->nagle.pending != NULL && (s->windowcount == 0 || nagle_due(&s->nagle, gettime())))
+    sender_sendpending(c);
+  if (s->nagle.hold > 0.0)
+    sender_armtimer(c);
+}
+
+/* pack a message, compressed if flags has PKT_COMPRESSED, with the
+   others on its stream waiting for the next packet */
+static void sender_pack(struct arq *c, struct msg message, int flags)
+{
+  struct sender *s = &c->sender;
+  char *data;
+
+  if (nagle_full(&s->nagle, message.length, message.stream))
+    sender_sendpending(c);
+  if (s->nagle.pending == NULL) {
+    /* the packet needs a window slot, kept for it until it is sent */
+    if (s->windowcount >= sender_window(c)) {
+      if (TRACE > 0)
+        printf("----A: New message arrives, send window is full\n");
+      window_full++;
+      return;
+    }
+  }
+  if (TRACE > 1)
+    printf("----A: New message arrives, packed for the next packet\n");
+  data = message.data != NULL ? message.data : pktbuf_data(message.buf);
+  nagle_pack(&s->nagle, data, message.length, (flags & PKT_COMPRESSED) != 0, message.stream, gettime());
+  sender_checkpending(c);
+}
+
+/* send a message, with flags its stream and PKT_COMPRESSED if it is compressed */
+static void sender_send(struct arq *c, struct msg message, int flags)
+{
+  struct sender *s = &c->sender;
+  struct pktbuf *buf;
+  char *data;
+  int npackets, offset;
+  int nbatch = 0;
+  int i;
+
+  /* with nagle=, messages small enough to share a packet are packed */
+  sender_checkpending(c);
+  if (nagle_packs(&s->nagle, message.length)) {
+    sender_pack(c, message, flags);
+    return;
+  }
+  sender_sendpending(c);
+
+  /* the number of packets the message is fragmented into */
+  npackets = message.length > c->datasize ? (message.length + c->datasize - 1) / c->datasize : 1;
+  if (npackets > c->windowsize) {
+    printf("%s: a message of %d bytes needs %d packets, more than the windowsize of %d\n",
+           c->policy->name, message.length, npackets, c->windowsize);
+    exit(EXIT_FAILURE);
+  }
+
+  /* if not blocked waiting on ACK.  A message of more packets than the
+     congestion window goes when none are in flight, or it never would */
+  if (s->windowcount == 0 || s->windowcount + npackets <= sender_window(c)) {
+    if (TRACE > 1)
+      printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
+
+    /* the packets share the message's buffer, which is made if it has none */
+    buf = message.buf;
+    data = message.data;
+    if (buf == NULL) {
+      buf = pktbuf_alloc(message.length);
+      for ( i=0; i<message.length ; i++ )
+        buf->data[i] = message.data[i];
+      data = buf->data;
+    }
+    else
+      pktbuf_hold(buf);
+
+    /* send out the message's packets together */
+    for (offset=0; npackets>0; npackets--, offset+=c->datasize)
+      s->batch[nbatch++] = *sender_queue(c, (npackets > 1 ? flags | PKT_MORE : flags) | (offset == 0 ? PKT_FIRST : 0),
+                                         npackets > 1 ? c->datasize : message.length - offset,
+                                         data != NULL ? data + offset : NULL, buf);
+    sender_transmit(c, s->batch, nbatch);
+    sender_sendparity(c);
+    pktbuf_release(buf);
+  }
+  /* if blocked,  window is full */
+  else {
+    if (TRACE > 0)
+      printf("----A: New message arrives, send window is full\n");
+    window_full++;
+  }
+}
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+static void sender_output(struct arq *c, struct msg message)
+{
+  struct pktbuf *buf;
+  int length, flags;
+
+  if (message.stream < 0 || message.stream >= c->nstreams) {
+    printf("%s: a message on stream %d, but there are %d streams\n", c->policy->name, message.stream, c->nstreams);
+    exit(EXIT_FAILURE);
+  }
+  flags = message.stream << PKT_STREAMSHIFT;
+  if (sender_expire(c) > 0) {
+    sender_stoptimer(c);
+    startwindowtimer(c);
+  }
+  if (!c->compress || message.length == 0) {
+    sender_send(c, message, flags);
+    return;
+  }
+
+  /* send the message compressed, if that makes it smaller */
+  buf = pktbuf_alloc(RLE_BOUND(message.length));
+  if (message.data != NULL)
+    length = rle_compress(message.data, message.length, buf->data);
+  else
+    length = rle_fill((char)message.buf->fill, message.length, buf->data);
+  if (length < message.length) {
+    message.length = length;
+    message.data = buf->data;
+    message.buf = buf;
+    sender_send(c, message, flags | PKT_COMPRESSED);
+  }
+  else
+    sender_send(c, message, flags);
+  pktbuf_release(buf);
+}
+
+/* take acknum from an ACK, selective or cumulative */
+static void sender_ack(struct arq *c, seq_t acknum, bool selective)
+{
+  struct sender *s = &c->sender;
+  seq_t seqfirst;
+  int ackcount, slot;
+  int i;
+
+  /* check if new ACK or duplicate: a new ACK lies in [first unacked, next to send) */
+  seqfirst = seq_sub(s->nextseqnum, s->windowcount);
+  if (s->windowcount != 0 && seq_leq(seqfirst, acknum) && seq_lt(acknum, s->nextseqnum)) {
+
+    /* packet is a new ACK */
+    if (TRACE > 0)
+      printf("----A: ACK %d is not a duplicate\n",(int)acknum);
+    new_ACKs++;
+
+    /* an ACK for a packet sent once times the round trip */
+    slot = ring_slot(s->windowfirst, seq_diff(acknum, seqfirst), c->windowmask);
+    if (s->resent != NULL)
+      cc_ack(&s->cc, !selective ? (int)seq_diff(acknum, seqfirst) + 1 : 1,
+             bitmap_test(s->resent, slot) ? -1.0 : gettime() - s->sendtime[slot], gettime());
+    sender_reportwindow(c);
+
+    /* rack=: the latest a packet acked was sent */
+    if (s->rack.window > 0.0)
+      rack_ack(&s->rack, slot, selective, s->sendtime[slot], bitmap_test(s->resent, slot));
+
+    if (!selective)
+      /* cumulative acknowledgement - everything up to acknum is ACKed */
+      ackcount = (int)seq_diff(acknum, seqfirst) + 1;
+    else {
+      /* selective acknowledgement - mark the packet, then take the run of
+         acked packets at the window base, a bitmap word at a time */
+      bitmap_set(s->acked, slot);
+      ackcount = bitmap_takerun(s->acked, c->windowmask + 1, s->windowfirst, s->windowcount);
+    }
+
+    /* slide window by the number of packets ACKed, releasing their payloads */
+    for (i=0; i<ackcount; i++)
+      pktbuf_release(s->buffer[ring_slot(s->windowfirst, i, c->windowmask)].buf);
+    s->windowfirst = ring_slot(s->windowfirst, ackcount, c->windowmask);
+    s->windowcount -= ackcount;
+
+    /* recovering from a timeout, an ACK that stops short of the packets
+       sent before it shows the receiver lacks the new window base too */
+    if (s->recovering && ackcount > 0) {
+      if (s->windowcount > 0 && seq_lt(seq_sub(s->nextseqnum, s->windowcount), s->recover) &&
+          !bitmap_test(s->queued, s->windowfirst)) {
+        if (TRACE > 0)
+          printf ("---A: resending packet %d\n", s->buffer[s->windowfirst].seqnum);
+        sender_transmit(c, sender_resend(c, s->windowfirst, true), 1);
+      }
+      else
+        s->recovering = false;
+    }
+
+    /* start timer again if the window base moved */
+    if (ackcount > 0) {
+      sender_stoptimer(c);
+      startwindowtimer(c);
+    }
+    s->rack.probed = false;
+    sender_armprobe(c);
+  }
+  else
+    if (TRACE > 0)
+      printf ("----A: duplicate ACK received, do nothing!\n");
+}
+
+/* called from layer 3, when a packet arrives for layer 4
+   In this practical this will always be an ACK as B never sends data.
+*/
+static void sender_input(struct arq *c, struct pkt packet)
+{
+  bool selective;
+  int i;
+
+  if (sender_expire(c) > 0) {
+    sender_stoptimer(c);
+    startwindowtimer(c);
+  }
+
+  /* if received ACK is not corrupted */
+  if (!IsCorrupted(packet)) {
+    if (TRACE > 0)
+      printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
+    total_ACKs_received++;
+    /* a hybrid's ACKs say which kind they are */
+    selective = c->policy->lossy != NULL ? (packet.flags & PKT_SELECTIVE) != 0 : c->policy->ack == ACK_SELECTIVE;
+    sender_ack(c, seq_of(packet.acknum), selective);
+
+    /* a selective ACK from a receive batch also carries the further
+       sequence numbers it acknowledges */
+    if (selective && packet.payload != NULL)
+      for (i=0; i+4<=packet.length; i+=4)
+        sender_ack(c, getseqnum(packet.payload + i), true);
+    sender_detect(c);
+  }
+  else
+    if (TRACE > 0)
+      printf ("----A: corrupted ACK is received, do nothing!\n");
+  sender_checkpending(c);
+}
+
+/* called when A's timer goes off */
+static void sender_timerinterrupt(struct arq *c)
+{
+  struct sender *s = &c->sender;
+  double now;
+  int nbatch = 0;
+  int i, slot;
+
+  /* a shared timer may have gone off for the next packet's turn, the
+     probe or the end of the hold */
+  if (sender_sharedtimer(c)) {
+    s->timerat = -1.0;
+    if (s->timeout < 0.0 || (float)s->timeout > (float)gettime()) {
+      if (sender_expire(c) > 0) {
+        sender_stoptimer(c);
+        startwindowtimer(c);
+      }
+      sender_probe(c);
+      sender_pace(c);
+      sender_checkpending(c);
+      return;
+    }
+    s->timeout = -1.0;
+  }
+
+  if (TRACE > 0)
+    printf("----A: time out,resend packets!\n");
+  sender_expire(c);
+  sender_adapt(c, true);
+  rack_timeout(&s->rack);
+
+  switch (s->mode->retransmit) {
+  case RETRANSMIT_WINDOW:
+    /* resend the window as one batch, as much of it as the congestion
+       window allows once the loss has cut it.  Packets still waiting for
+       their turn (pace=), or acked before a hybrid went back N, are not
+       resent */
+    for (i=0; i<s->windowcount && i<sender_window(c); i++) {
+      slot = ring_slot(s->windowfirst, i, c->windowmask);
+      if (bitmap_test(s->queued, slot) || bitmap_test(s->acked, slot))
+        continue;
+      if (TRACE > 0)
+        printf ("---A: resending packet %d\n", s->buffer[slot].seqnum);
+      s->batch[nbatch++] = *sender_resend(c, slot, true);
+    }
+    if (s->windowcount > 0)
+      sender_starttimer(c, c->rtt);
+    sender_transmit(c, s->batch, nbatch);
+    break;
+
+  case RETRANSMIT_OLDEST:
+    if (s->windowcount == 0)
+      break;
+    if (!bitmap_test(s->queued, s->windowfirst)) {
+      if (TRACE > 0)
+        printf ("---A: resending packet %d\n", s->buffer[s->windowfirst].seqnum);
+      sender_transmit(c, sender_resend(c, s->windowfirst, true), 1);
+    }
+    sender_starttimer(c, c->rtt);
+    break;
+
+  case RETRANSMIT_RECOVER:
+    /* resend the oldest, and the rest one by one as ACKs show they are missing */
+    if (s->windowcount == 0)
+      break;
+    if (!bitmap_test(s->queued, s->windowfirst)) {
+      if (TRACE > 0)
+        printf ("---A: resending packet %d\n", s->buffer[s->windowfirst].seqnum);
+      sender_transmit(c, sender_resend(c, s->windowfirst, true), 1);
+    }
+    s->recover = s->nextseqnum;
+    s->recovering = true;
+    sender_starttimer(c, c->rtt);
+    break;
+
+  case RETRANSMIT_EACH:
+    /* resend the packets whose own timeout has expired.  Event times are
+       floats, so deadlines are compared at float precision */
+    now = gettime();
+    for (i=0; i<s->windowcount; i++) {
+      slot = ring_slot(s->windowfirst, i, c->windowmask);
+      if (!bitmap_test(s->acked, slot) && !bitmap_test(s->queued, slot) &&
+          (float)(s->sendtime[slot] + c->rtt) <= (float)now) {
+        if (TRACE > 0)
+          printf ("---A: resending packet %d\n", s->buffer[slot].seqnum);
+        s->batch[nbatch++] = *sender_resend(c, slot, true);
+      }
+    }
+    sender_transmit(c, s->batch, nbatch);
+    startwindowtimer(c);
+    break;
+  }
+  sender_checkpending(c);
+}
+
+
+/********* Receiver (B) functions ************/
+
+/* send a selective or cumulative ACK packet carrying acknum from B, and
+   the nmore sequence numbers more in its payload */
+static void sendack(struct arq *c, bool selective, int acknum, const seq_t *more, int nmore)
+{
+  struct pkt sendpkt;
+  int i;
+
+  sendpkt.acknum = acknum;
+  sendpkt.seqnum = c->receiver.nextseqnum;
+  c->receiver.nextseqnum = (c->receiver.nextseqnum + 1) % 2;
+
+  /* we don't have any data to send.  A hybrid says if the ACK is selective */
+  sendpkt.flags = 0;
+  if (c->policy->lossy != NULL && selective)
+    sendpkt.flags = PKT_SELECTIVE;
+  sendpkt.length = 4 * nmore;
+  sendpkt.payload = NULL;
+  sendpkt.buf = NULL;
+  if (nmore > 0) {
+    for (i=0; i<nmore; i++)
+      putseqnum(c->receiver.ackpayload + 4 * i, more[i]);
+    sendpkt.payload = c->receiver.ackpayload;
+  }
+
+  /* compute checksum */
+  sendpkt.checksum = ComputeChecksum(sendpkt);
+
+  /* send out packet */
+  tolayer3 (B, sendpkt);
+}
+
+/* deliver the messages waiting in the batch to layer 5 */
+static void flush(struct arq *c)
+{
+  struct receiver *r = &c->receiver;
+
+  if (r->nbatch == 1)
+    tolayer5(B, r->batch[0]);
+  else if (r->nbatch > 1)
+    tolayer5_batch(B, r->batch, r->nbatch);
+  r->nbatch = 0;
+}
+
+/* queue a compressed message of length bytes on a stream for layer 5,
+   expanded.  The expansion is reused by the next one, so the message
+   goes out at once.  Data that does not expand (it was corrupted) is
+   delivered as it is */
+static void deliver_expanded(struct arq *c, char *data, int length, int stream)
+{
+  struct receiver *r = &c->receiver;
+  struct msg *message;
+  int n;
+
+  if (r->nbatch == r->maxbatch)
+    flush(c);
+  message = &r->batch[r->nbatch++];
+  message->length = length;
+  message->data = data;
+  message->buf = NULL;
+  message->stream = stream;
+  n = rle_length(data, length);
+  if (n >= 0) {
+    if (n > r->expandedsize) {
+      while (n > r->expandedsize)
+        r->expandedsize *= 2;
+      r->expanded = realloc(r->expanded, r->expandedsize);
+      if (r->expanded == NULL) {
+        printf("memory allocation for message failed.\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    message->length = rle_expand(data, length, r->expanded);
+    message->data = r->expanded;
+  }
+  flush(c);
+}
+
+/* add a packet received in order to the message being reassembled, and
+   queue the message for layer 5 if it is the last packet of it.  A
+   queued message may point at the packet's payload, so the packet must
+   be kept until the batch is flushed */
+static void deliver(struct arq *c, struct pkt *packet)
+{
+  struct receiver *r = &c->receiver;
+  struct stream *m;
+  struct msg *message;
+  char *data;
+  int i, length, stream;
+  bool compressed;
+
+  if (r->nbatch == r->maxbatch)
+    flush(c);
+
+  /* each stream reassembles its own messages */
+  stream = (packet->flags & PKT_STREAM) >> PKT_STREAMSHIFT;
+  if (stream >= c->nstreams)
+    stream = 0;   /* corrupted */
+  m = &r->streams[stream];
+
+  /* with deadline=, a message is dropped if the sender abandoned part of
+     it: a packet that does not follow the stream's last one is skipped,
+     up to the start of the next message */
+  if (packet->flags & PKT_FIRST)
+    stream_drop(m);
+  else if (c->deadline.lifetime > 0.0 && m->last != seq_sub(packet->seqnum, 1)) {
+    stream_drop(m);
+    return;
+  }
+  m->last = seq_of(packet->seqnum);
+
+  /* packed messages are delivered straight from the payload, up to any
+     whose length runs past its end (the packet was corrupted) */
+  if (packet->flags & PKT_PACKED) {
+    data = packet->payload != NULL ? packet->payload : pktbuf_data(packet->buf);
+    for (i=0; (length = nagle_unpack(data, packet->length, &i, &compressed)) >= 0; i+=length) {
+      if (compressed) {
+        deliver_expanded(c, data + i, length, stream);
+        continue;
+      }
+      if (r->nbatch == r->maxbatch)
+        flush(c);
+      message = &r->batch[r->nbatch++];
+      message->length = length;
+      message->data = data + i;
+      message->buf = packet->buf;
+      message->stream = stream;
+    }
+    return;
+  }
+
+  /* a whole message in one packet is delivered straight from its payload */
+  if (m->messagelength == 0 && !(packet->flags & PKT_MORE) && (packet->flags & PKT_COMPRESSED)) {
+    deliver_expanded(c, packet->payload != NULL ? packet->payload : pktbuf_data(packet->buf), packet->length, stream);
+    return;
+  }
+  if (m->messagelength == 0 && !(packet->flags & PKT_MORE)) {
+    message = &r->batch[r->nbatch++];
+    message->length = packet->length;
+    message->data = packet->payload;
+    message->buf = packet->buf;
+    message->stream = stream;
+    return;
+  }
+
+  stream_append(m, packet);
+
+  /* a reassembled message goes out at once, as the next one reuses its buffer */
+  if (!(packet->flags & PKT_MORE) && (packet->flags & PKT_COMPRESSED) && m->messagebuf == NULL) {
+    deliver_expanded(c, m->message, m->messagelength, stream);
+    stream_done(m);
+  }
+  else if (!(packet->flags & PKT_MORE)) {
+    message = &r->batch[r->nbatch++];
+    message->length = m->messagelength;
+    message->data = m->messagebuf != NULL ? NULL : m->message;
+    message->buf = m->messagebuf;
+    message->stream = stream;
+    flush(c);
+    stream_done(m);
+  }
+}
+
+/* deliver the run of held packets from window slot first on, which
+   are now in order, in one batch straight from the packets */
+static void deliver_run(struct arq *c, int first)
+{
+  struct receiver *r = &c->receiver;
+  int delivered;
+  int i, slot;
+
+  delivered = bitmap_takerun(r->received, c->windowmask + 1, first, c->windowsize);
+  for (i=0; i<delivered; i++) {
+    slot = ring_slot(first, i, c->windowmask);
+    if (bitmap_test(r->ahead, slot))
+      bitmap_clear(r->ahead, slot);
+    else
+      deliver(c, &r->recv_buffer[slot]);
+  }
+  flush(c);
+  for (i=0; i<delivered; i++)
+    pktbuf_release(r->recv_buffer[ring_slot(first, i, c->windowmask)].buf);
+  r->windowfirst = ring_slot(first, delivered, c->windowmask);
+  r->expectedseqnum = seq_add(r->expectedseqnum, delivered);
+}
+
+/* with streams=, deliver the packet held at window offset, and those
+   after it on its stream that it lets go, if the stream's packet before
+   it is delivered: before the window, or ahead of it */
+static void deliver_ahead(struct arq *c, seq_t offset)
+{
+  struct receiver *r = &c->receiver;
+  struct pkt *packet;
+  seq_t i, prev;
+  int slot, stream = -1;
+
+  for (i=offset; i<(seq_t)c->windowsize; i++) {
+    slot = ring_slot(r->windowfirst, i, c->windowmask);
+    if (!bitmap_test(r->received, slot) || bitmap_test(r->ahead, slot))
+      continue;
+    packet = &r->recv_buffer[slot];
+    if (stream >= 0 && (packet->flags & PKT_STREAM) >> PKT_STREAMSHIFT != stream)
+      continue;
+    /* with deadline= a packet repaired from parity has lost the sender's
+       window base, so the stream's packet before it, acked but not yet
+       delivered behind an abandoned one, may still be held */
+    prev = (packet->flags & PKT_PREV) >> PKT_PREVSHIFT;
+    if ((prev != 0 && prev <= i && !bitmap_test(r->ahead, ring_slot(r->windowfirst, i - prev, c->windowmask))) ||
+        (prev == 0 && c->deadline.lifetime > 0.0 && !(packet->flags & PKT_FORWARD))) {
+      if (i == offset)
+        return;   /* waiting for the packet before it */
+      continue;
+    }
+    if (TRACE > 0)
+      printf("----B: packet %d is delivered ahead of packet %d\n", packet->seqnum, (int)r->expectedseqnum);
+    deliver(c, packet);
+    bitmap_set(r->ahead, slot);
+    stream = (packet->flags & PKT_STREAM) >> PKT_STREAMSHIFT;
+  }
+  flush(c);
+}
+
+/* with deadline=, move the window up to the sender's window base: the
+   packets before it will not come again, so those held are delivered
+   and a message missing any of the rest is dropped */
+static void receiver_forward(struct arq *c, seq_t base)
+{
+  struct receiver *r = &c->receiver;
+  seq_t n, i;
+  int slot;
+
+  n = seq_diff(base, r->expectedseqnum);
+  if (n == 0 || n > (seq_t)c->windowsize)
+    return;   /* not ahead of the window */
+  if (TRACE > 0)
+    printf("----B: the sender abandoned packets, skipping to packet %d\n", (int)base);
+  for (i=0; i<n; i++) {
+    slot = ring_slot(r->windowfirst, i, c->windowmask);
+    if (bitmap_test(r->received, slot)) {
+      bitmap_clear(r->received, slot);
+      if (bitmap_test(r->ahead, slot))
+        bitmap_clear(r->ahead, slot);
+      else
+        deliver(c, &r->recv_buffer[slot]);
+      flush(c);
+      pktbuf_release(r->recv_buffer[slot].buf);
+    }
+  }
+  r->windowfirst = ring_slot(r->windowfirst, n, c->windowmask);
+  r->expectedseqnum = base;
+  deliver_run(c, r->windowfirst);
+}
+
+/* take a packet arriving at B.  Returns false if it is corrupted, when
+   a selective ACK cannot name it, or carries no data */
+static bool receive(struct arq *c, struct pkt packet)
+{
+  struct receiver *r = &c->receiver;
+  seq_t offset;
+  int slot;
+
+  if (IsCorrupted(packet)) {
+    if (r->mode->ack == ACK_CUMULATIVE && TRACE > 0)
+      printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
+    return(false);
+  }
+  if (c->policy->lossy != NULL && !(packet.flags & PKT_CONTROL))
+    r->mode = packet.flags & PKT_SELECTIVE ? c->policy->lossy : c->policy;
+  if (packet.flags & PKT_FORWARD)
+    receiver_forward(c, seq_of(packet.acknum));
+  if (packet.flags & PKT_CONTROL)
+    return(false);
+
+  /* accept the expected packet, and later packets in the window if the receiver buffers */
+  offset = seq_diff(packet.seqnum, r->expectedseqnum);
+  if (offset == 0 || (r->mode->receive == RECEIVE_BUFFER && offset < (seq_t)c->windowsize)) {
+    if (TRACE > 0)
+      printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
+    packets_received++;
+
+    if (offset == 0) {
+      /* deliver to receiving application, followed by any buffered run
+         that is now in order */
+      deliver(c, &packet);
+      r->expectedseqnum = seq_add(r->expectedseqnum, 1);
+      deliver_run(c, ring_slot(r->windowfirst, 1, c->windowmask));
+    }
+    else {
+      /* hold the packet (a reference to its payload) until the packets
+         before it arrive */
+      slot = ring_slot(r->windowfirst, offset, c->windowmask);
+      if (!bitmap_test(r->received, slot)) {
+        r->recv_buffer[slot] = packet;
+        if (packet.buf != NULL)
+          pktbuf_hold(packet.buf);
+        bitmap_set(r->received, slot);
+        if (c->nstreams > 1)
+          deliver_ahead(c, offset);
+      }
+    }
+  }
+  else if (r->mode->ack == ACK_SELECTIVE) {
+    /* an old packet whose ACK was lost, ACK it again */
+    if (TRACE > 0)
+      printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
+    packets_received++;
+  }
+  else
+    if (TRACE > 0)
+      printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
+  return(true);
+}
+
+/* receive packets that arrived at B together, ACKing them together: with
+   one cumulative ACK, or with selective ACKs that each carry as many of
+   their sequence numbers as fit */
+static void receive_batch(struct arq *c, struct pkt packets[], int n)
+{
+  struct receiver *r = &c->receiver;
+  int i;
+
+  for (i=0; i<n; i++)
+    if (receive(c, packets[i]) && r->mode->ack == ACK_SELECTIVE) {
+      if (r->nacks == r->maxacks) {
+        sendack(c, true, (int)r->acks[0], r->acks + 1, r->nacks - 1);
+        r->nacks = 0;
+      }
+      r->acks[r->nacks++] = seq_of(packets[i].seqnum);
+    }
+  /* a hybrid may have gone back N part way through the batch, after
+     packets it ACKs selectively */
+  if (r->nacks > 0) {
+    sendack(c, true, (int)r->acks[0], r->acks + 1, r->nacks - 1);
+    r->nacks = 0;
+  }
+  if (r->mode->ack == ACK_CUMULATIVE)
+    sendack(c, false, (int)seq_sub(r->expectedseqnum, 1), NULL, 0);
+}
+
+/* keep a packet with its FEC block, and receive the packets of the
+   block if that repairs it */
+static void receiver_store(struct arq *c, struct pkt *packet)
+{
+  int n;
+
+  n = fec_store(&c->fec, packet, c->receiver.mode != c->policy,
+                c->receiver.mode->receive == RECEIVE_DISCARD);
+  if (n > 0) {
+    receive_batch(c, c->fec.repaired, n);
+    fec_received(&c->fec);
+  }
+}
+
+/* called from layer 3 with packets that arrived at B together.  With
+   fec= the data packets among them are received as usual, and all are
+   kept with their blocks in case a block needs repair */
+static void receiver_input_batch(struct arq *c, struct pkt packets[], int n)
+{
+  int i, next;
+
+  if (c->fec.mode == FEC_NONE) {
+    receive_batch(c, packets, n);
+    return;
+  }
+  for (i=0; i<n; i=next) {
+    for (next=i; next<n && !(packets[next].flags & PKT_PARITY); next++)
+      ;
+    if (next > i) {
+      receive_batch(c, packets + i, next - i);
+      for (; i<next; i++)
+        if (!IsCorrupted(packets[i]) && !(packets[i].flags & PKT_CONTROL))
+          receiver_store(c, &packets[i]);
+    }
+    else {
+      if (!IsCorrupted(packets[i]))
+        receiver_store(c, &packets[i]);
+      next++;
+    }
+  }
+}
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+static void receiver_input(struct arq *c, struct pkt packet)
+{
+  bool received;
+
+  if (c->fec.mode != FEC_NONE) {
+    receiver_input_batch(c, &packet, 1);
+    return;
+  }
+
+  /* send an ACK for the received packet.  A selective ACK needs the
+     packet's sequence number, so stay silent if it is corrupted */
+  received = receive(c, packet);
+  if (c->receiver.mode->ack == ACK_CUMULATIVE)
+    sendack(c, false, (int)seq_sub(c->receiver.expectedseqnum, 1), NULL, 0);
+  else if (received)
+    sendack(c, true, packet.seqnum, NULL, 0);
+}
+
+/********* Protocol callbacks ************/
+
+/* called from layer 5 (application layer), passed the message to be sent to other side.
+   Note that with simplex transfer from A to B, only A sends */
+void arq_output(void *c, int AorB, struct msg message)
+{
+  if (AorB == A)
+    sender_output(c, message);
+}
+
+/* called from layer 3, when a packet arrives for layer 4 at A or B */
+void arq_input(void *c, int AorB, struct pkt packet)
+{
+  if (AorB == A)
+    sender_input(c, packet);
+  else
+    receiver_input(c, packet);
+}
+
+/* called from layer 3 with packets that arrived at A or B together */
+void arq_input_batch(void *c, int AorB, struct pkt packets[], int n)
+{
+  int i;
+
+  if (AorB == A)
+    for (i=0; i<n; i++)
+      sender_input(c, packets[i]);
+  else
+    receiver_input_batch(c, packets, n);
+}
+
+/* called when A's or B's timer goes off.  B never starts its timer */
+void arq_timerinterrupt(void *c, int AorB)
+{
+  if (AorB == A)
+    sender_timerinterrupt(c);
+}
@@ -0,0 +1,52 @@
+/* Sliding window ARQ engine.  Go Back N, Selective Repeat and the
+   alternating bit protocols share one sender and one receiver, and differ
+   only in the policies below.  Each protocol is a struct arq_policy
+   (see gbn.c, sr.c, abp.c and hybrid.c) wrapped in a struct protocol;
+   the protocol= option picks one at startup.  A hybrid protocol switches
+   between two policies as the loss it sees changes. */
+
+/* acknowledgement policies */
+#define ACK_CUMULATIVE  0   /* acknum is the last packet received in order */
+#define ACK_SELECTIVE   1   /* acknum is the packet being acknowledged */
+
+/* retransmission policies, applied when A's timer goes off */
+#define RETRANSMIT_WINDOW  0   /* resend every unacked packet in the window */
+#define RETRANSMIT_OLDEST  1   /* resend only the oldest unacked packet */
+#define RETRANSMIT_EACH    2   /* resend each packet whose own timeout has expired */
+#define RETRANSMIT_RECOVER 3   /* resend the oldest, then each hole later cumulative ACKs stop at */
+
+/* receive policies for packets that arrive ahead of the one expected */
+#define RECEIVE_DISCARD  0   /* drop them, the sender will go back for them */
+#define RECEIVE_BUFFER   1   /* hold them until the gap before them is filled */
+
+struct arq_policy {
+  const char *name;   /* the name that selects this protocol with protocol= */
+  int ack;            /* ACK_ policy */
+  int retransmit;     /* RETRANSMIT_ policy */
+  int receive;        /* RECEIVE_ policy */
+  int maxwindow;      /* the largest window the sequence space allows */
+  const struct arq_policy *lossy;  /* the policy switched to while loss is high, NULL for none */
+};
+
+extern const struct arq_policy gbn_policy;
+extern const struct arq_policy gbnb_policy;
+extern const struct arq_policy sr_policy;
+extern const struct arq_policy srt_policy;
+extern const struct arq_policy abp_policy;
+extern const struct arq_policy hybrid_policy;
+
+/* the protocols built on the engine, see protocol.h */
+extern const struct protocol gbn_protocol;
+extern const struct protocol gbnb_protocol;
+extern const struct protocol sr_protocol;
+extern const struct protocol srt_protocol;
+extern const struct protocol abp_protocol;
+extern const struct protocol hybrid_protocol;
+
+/* protocol callbacks shared by every policy.  A protocol's init callback
+   returns arq_create() of its policy */
+extern void *arq_create(const struct arq_policy *);
+extern void arq_output(void *, int, struct msg);
+extern void arq_input(void *, int, struct pkt);
+extern void arq_input_batch(void *, int, struct pkt *, int);
+extern void arq_timerinterrupt(void *, int);
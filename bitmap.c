@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include "bitmap.h"
+
+/* number of trailing zero bits in a non-zero word */
+#if defined(__GNUC__)
+#define ctz(w) __builtin_ctzl(w)
+#else
+static int ctz(unsigned long w)
+{
+  int n = 0;
+
+  while ((w & 1UL) == 0) {
+    w >>= 1;
+    n++;
+  }
+  return(n);
+}
+#endif
+
+int bitmap_roundup(int nbits)
+{
+  return ((nbits + BITMAP_WORDBITS - 1) / BITMAP_WORDBITS) * BITMAP_WORDBITS;
+}
+
+unsigned long *bitmap_alloc(int nbits)
+{
+  unsigned long *map;
+
+  map = calloc(bitmap_roundup(nbits) / BITMAP_WORDBITS, sizeof(unsigned long));
+  if (map == NULL) {
+    printf("memory allocation for bitmap failed.\n");
+    exit(EXIT_FAILURE);
+  }
+  return(map);
+}
+
+void bitmap_set(unsigned long *map, int bit)
+{
+  map[bit / BITMAP_WORDBITS] |= 1UL << (bit % BITMAP_WORDBITS);
+}
+
+void bitmap_clear(unsigned long *map, int bit)
+{
+  map[bit / BITMAP_WORDBITS] &= ~(1UL << (bit % BITMAP_WORDBITS));
+}
+
+int bitmap_test(const unsigned long *map, int bit)
+{
+  return ((map[bit / BITMAP_WORDBITS] >> (bit % BITMAP_WORDBITS)) & 1UL) != 0;
+}
+
+/* the run is found a word at a time: the trailing ones of the word, shifted */
+/* down to the current bit, are counted with one count-trailing-zeros of its  */
+/* complement, so a fully acked word costs the same as a single packet        */
+int bitmap_takerun(unsigned long *map, int nbits, int first, int max)
+{
+  int count = 0;
+  int bit = first;
+  int offset, ones;
+  unsigned long word, mask;
+
+  while (count < max) {
+    offset = bit % BITMAP_WORDBITS;
+    word = map[bit / BITMAP_WORDBITS] >> offset;
+    if (~word == 0)
+      ones = BITMAP_WORDBITS - offset;
+    else
+      ones = ctz(~word);
+    if (ones > max - count)
+      ones = max - count;
+    if (ones == 0)
+      break;
+
+    /* clear the bits of the run in this word */
+    if (ones == BITMAP_WORDBITS)
+      mask = ~0UL;
+    else
+      mask = ((1UL << ones) - 1) << offset;
+    map[bit / BITMAP_WORDBITS] &= ~mask;
+
+    count += ones;
+    bit = (bit + ones) & (nbits - 1);
+    if (offset + ones < BITMAP_WORDBITS)
+      break;    /* the run ended inside this word */
+  }
+  return(count);
+}
@@ -0,0 +1,25 @@
+/* fixed size bit sets, used by the sliding window protocols to track which */
+/* packets in the window have been acked (sender) or received (receiver).    */
+/* A bitmap is an array of unsigned long; bit i of the set is bit            */
+/* i % BITMAP_WORDBITS of word i / BITMAP_WORDBITS.                          */
+
+#include <limits.h>
+
+#define BITMAP_WORDBITS ((int)(CHAR_BIT * sizeof(unsigned long)))
+
+/* round a number of bits up to a whole number of words */
+extern int bitmap_roundup(int);
+
+/* allocate a cleared bitmap of (int) bits, rounded up to whole words */
+extern unsigned long *bitmap_alloc(int);
+
+/* set, clear and test bit (int) */
+extern void bitmap_set(unsigned long *, int);
+extern void bitmap_clear(unsigned long *, int);
+extern int bitmap_test(const unsigned long *, int);
+
+/* count and clear the run of set bits starting at bit first, wrapping at   */
+/* nbits (a power of two multiple of BITMAP_WORDBITS, see ring.h),         */
+/* stopping after at most max bits.                                         */
+/* args: bitmap, nbits, first, max.  Returns the length of the run          */
+extern int bitmap_takerun(unsigned long *, int, int, int);
@@ -0,0 +1,240 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "cc.h"
+
+/* ******************************************************************
+   Congestion controllers for the sliding window sender.  Losses are
+   the sender's timeouts; those within a round trip of the first are
+   taken as one congestion event.
+   - aimd: Reno style.  Slow start doubles the window each round trip
+   up to ssthresh, then it grows by one packet per round trip, and a
+   loss halves it.
+   - cubic: CUBIC style.  A loss cuts the window to 0.7 of wmax, its
+   size then, and it grows back along a cubic in round trips since the
+   loss: quickly at first, flat near wmax, then probing beyond it.
+   - model: BBR style.  Rather than react to loss, it measures the
+   delivery rate each round trip and keeps the window at twice the
+   highest rate times the least RTT seen (the bandwidth-delay
+   product), after a startup that doubles the window until the rate
+   stops growing.
+   - bdp: window auto-tuning.  It too measures the delivery rate each
+   round trip, and sets the window to a quarter over the best rate of
+   the last CC_RATES round trips times the least RTT, plus BDP_PROBE
+   packets to find out whether the link takes more.  It grows by at
+   most double a round trip and does not react to loss: losses show up
+   as a lower delivery rate, which shrinks the window.
+**********************************************************************/
+
+#define CC_INITIAL 2       /* the first congestion window, packets */
+#define CUBIC_C 0.4        /* cubic growth, packets per round trip cubed */
+#define CUBIC_BETA 0.7     /* the window kept on a loss */
+#define MODEL_GAIN 2.0     /* the window over the bandwidth-delay product */
+#define MODEL_MIN 4.0      /* the least window of the model */
+#define MODEL_DECAY 0.95   /* the highest rate decays by this each round trip */
+#define BDP_GAIN 1.25      /* the window over the bandwidth-delay product */
+#define BDP_PROBE 2.0      /* packets more than that */
+
+/* cube root by Newton's method, which from above x converges down to it */
+static double cuberoot(double x)
+{
+  double y, last;
+
+  if (x <= 0.0)
+    return(0.0);
+  y = x > 1.0 ? x : 1.0;
+  do {
+    last = y;
+    y -= (y * y * y - x) / (3.0 * y * y);
+  } while (y < last);
+  return(last);
+}
+
+/* grow the window for packets acked: by slow start below ssthresh, else
+   by the controller's increase */
+static void grow(struct cc *cc, int acked, double increase)
+{
+  if (cc->cwnd < cc->ssthresh)
+    cc->cwnd += acked;
+  else
+    cc->cwnd += increase;
+}
+
+static void aimd_ack(struct cc *cc, int acked, double now)
+{
+  grow(cc, acked, (double)acked / cc->cwnd);
+}
+
+static void aimd_loss(struct cc *cc, double now)
+{
+  cc->cwnd /= 2.0;
+  cc->ssthresh = cc->cwnd;
+}
+
+static void cubic_ack(struct cc *cc, int acked, double now)
+{
+  double t, target;
+
+  /* the window the cubic gives a round trip from now */
+  t = (now - cc->epoch) / cc->srtt + 1.0 - cc->k;
+  target = CUBIC_C * t * t * t + cc->wmax;
+  if (target > cc->cwnd)
+    grow(cc, acked, (target - cc->cwnd) / cc->cwnd * acked);
+  else
+    grow(cc, acked, 0.01 * acked / cc->cwnd);
+}
+
+static void cubic_loss(struct cc *cc, double now)
+{
+  cc->wmax = cc->cwnd;
+  cc->cwnd *= CUBIC_BETA;
+  cc->ssthresh = cc->cwnd;
+  cc->epoch = now;
+  cc->k = cuberoot(cc->wmax * (1.0 - CUBIC_BETA) / CUBIC_C);
+}
+
+static void model_ack(struct cc *cc, int acked, double now)
+{
+  double rtt, rate;
+
+  /* measure the delivery rate over each round trip */
+  rtt = cc->minrtt > 0.0 ? cc->minrtt : cc->srtt;
+  cc->roundacked += acked;
+  if (now - cc->roundstart >= rtt) {
+    rate = cc->roundacked / (now - cc->roundstart);
+    if (!cc->filled) {
+      if (rate > cc->btlbw * 1.25)
+        cc->fullrounds = 0;
+      else if (++cc->fullrounds >= 3)
+        cc->filled = true;
+    }
+    cc->btlbw = rate > cc->btlbw * MODEL_DECAY ? rate : cc->btlbw * MODEL_DECAY;
+    cc->roundstart = now;
+    cc->roundacked = 0;
+  }
+
+  if (!cc->filled)
+    cc->cwnd += acked;
+  else {
+    cc->cwnd = MODEL_GAIN * cc->btlbw * rtt;
+    if (cc->cwnd < MODEL_MIN)
+      cc->cwnd = MODEL_MIN;
+  }
+}
+
+static void model_loss(struct cc *cc, double now)
+{
+  /* a loss in startup shows the pipe is full */
+  cc->filled = true;
+}
+
+static void bdp_ack(struct cc *cc, int acked, double now)
+{
+  double rtt, best, target;
+  int i;
+
+  rtt = cc->minrtt > 0.0 ? cc->minrtt : cc->srtt;
+  cc->roundacked += acked;
+  if (now - cc->roundstart < rtt)
+    return;
+  cc->rates[cc->round++ % CC_RATES] = cc->roundacked / (now - cc->roundstart);
+  cc->roundstart = now;
+  cc->roundacked = 0;
+
+  best = 0.0;
+  for (i=0; i<CC_RATES; i++)
+    if (cc->rates[i] > best)
+      best = cc->rates[i];
+  target = BDP_GAIN * best * rtt + BDP_PROBE;
+  cc->cwnd = target < 2.0 * cc->cwnd ? target : 2.0 * cc->cwnd;
+}
+
+static void bdp_loss(struct cc *cc, double now)
+{
+}
+
+static const struct ccalgo algos[] = {
+  { "aimd", aimd_ack, aimd_loss },
+  { "cubic", cubic_ack, cubic_loss },
+  { "model", model_ack, model_loss },
+  { "bdp", bdp_ack, bdp_loss }
+};
+
+#define NALGOS (sizeof(algos) / sizeof(algos[0]))
+
+const struct ccalgo *cc_find(const char *name)
+{
+  size_t i;
+
+  for (i=0; i<NALGOS; i++)
+    if (strcmp(algos[i].name, name) == 0)
+      return(&algos[i]);
+  return(NULL);
+}
+
+void cc_init(struct cc *cc, const struct ccalgo *algo, int minwindow, int maxwindow, double rtt)
+{
+  int i;
+
+  cc->algo = algo;
+  cc->minwindow = minwindow;
+  cc->maxwindow = maxwindow;
+  cc->cwnd = CC_INITIAL < maxwindow ? CC_INITIAL : maxwindow;
+  if (cc->cwnd < minwindow)
+    cc->cwnd = minwindow;
+  cc->ssthresh = maxwindow;
+  cc->srtt = rtt;
+  cc->minrtt = 0.0;
+  cc->recovery = 0.0;
+  cc->wmax = maxwindow;
+  cc->epoch = 0.0;
+  cc->k = 0.0;
+  cc->btlbw = 0.0;
+  cc->roundstart = 0.0;
+  cc->roundacked = 0;
+  cc->fullrounds = 0;
+  cc->filled = false;
+  for (i=0; i<CC_RATES; i++)
+    cc->rates[i] = 0.0;
+  cc->round = 0;
+}
+
+/* keep the window between the sender's minwindow and windowsize */
+static void clamp(struct cc *cc)
+{
+  if (cc->cwnd > cc->maxwindow)
+    cc->cwnd = cc->maxwindow;
+  if (cc->cwnd < cc->minwindow)
+    cc->cwnd = cc->minwindow;
+  if (cc->ssthresh < 2.0)
+    cc->ssthresh = 2.0;
+}
+
+void cc_ack(struct cc *cc, int acked, double rtt, double now)
+{
+  if (rtt >= 0.0) {
+    cc->srtt += (rtt - cc->srtt) / 8.0;
+    if (cc->minrtt == 0.0 || rtt < cc->minrtt)
+      cc->minrtt = rtt;
+  }
+  if (cc->algo == NULL)
+    return;
+  cc->algo->ack(cc, acked, now);
+  clamp(cc);
+}
+
+void cc_loss(struct cc *cc, double now)
+{
+  if (cc->algo == NULL || now < cc->recovery)
+    return;
+  cc->recovery = now + cc->srtt;
+  cc->algo->loss(cc, now);
+  clamp(cc);
+}
+
+int cc_window(const struct cc *cc)
+{
+  if (cc->algo == NULL)
+    return((int)cc->maxwindow);
+  return((int)cc->cwnd);
+}
@@ -0,0 +1,59 @@
+/* congestion control of a sender's window.  A controller keeps a        */
+/* congestion window (cwnd) of packets that ACKs grow and losses shrink, */
+/* and the sender keeps at most the smaller of it and its windowsize in  */
+/* flight.  Controllers are chosen by name with cc_find().  Without one  */
+/* only the RTT is estimated                                             */
+
+#include <stdbool.h>
+
+#define CC_RATES 4   /* bdp: the round trips the best delivery rate is kept over */
+
+struct cc;
+
+/* a congestion controller */
+struct ccalgo {
+  const char *name;
+  void (*ack)(struct cc *, int, double);   /* packets newly acked (int), time */
+  void (*loss)(struct cc *, double);       /* a loss detected at time */
+};
+
+/* the state of a sender's congestion control */
+struct cc {
+  const struct ccalgo *algo;   /* the controller, NULL for none */
+  double cwnd;          /* congestion window, packets */
+  double ssthresh;      /* slow start threshold, packets */
+  double minwindow;     /* the least cwnd is cut to */
+  double maxwindow;     /* the sender's windowsize, which cwnd never exceeds */
+  double srtt;          /* smoothed round trip time */
+  double minrtt;        /* the least round trip time sampled, 0 before the first */
+  double recovery;      /* losses before this time are part of the last one */
+  double wmax;          /* cubic: the window at the last loss */
+  double epoch;         /* cubic: the time of the last loss */
+  double k;             /* cubic: round trips from it until the window is back at wmax */
+  double btlbw;         /* model: the highest delivery rate measured, packets per time unit */
+  double roundstart;    /* model, bdp: the time the round trip being measured began */
+  int roundacked;       /* model, bdp: packets acked in it */
+  int fullrounds;       /* model: round trips in a row the rate grew less than a quarter */
+  bool filled;          /* model: startup is over */
+  double rates[CC_RATES];  /* bdp: the delivery rates of the last round trips */
+  int round;            /* bdp: round trips measured */
+};
+
+/* the controller of a name (char *): "aimd", "cubic", "model" or       */
+/* "bdp", or NULL if there is none of that name                         */
+extern const struct ccalgo *cc_find(const char *);
+
+/* start a sender's congestion control with a controller (or NULL), the */
+/* least window (int), its windowsize (int) and its timeout (double) as */
+/* the first RTT estimate                                               */
+extern void cc_init(struct cc *, const struct ccalgo *, int, int, double);
+
+/* packets (int) newly acked at a time (double), with an RTT sample, or */
+/* a negative one if the ACK gives none                                 */
+extern void cc_ack(struct cc *, int, double, double);
+
+/* a packet was lost (or timed out) at a time (double) */
+extern void cc_loss(struct cc *, double);
+
+/* the number of packets the sender may have in flight */
+extern int cc_window(const struct cc *);
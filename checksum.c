@@ -0,0 +1,273 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "emulator.h"
+#include "checksum.h"
+
+/* -DCRC32C_TABLE always uses the sliced table (see checksumbench.c) */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(CRC32C_TABLE)
+#include <nmmintrin.h>
+#define HAVE_SSE42 1
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* ******************************************************************
+   Packet checksums.  The checksum= option selects the algorithm used
+   by ComputeChecksum():
+   - sum:    the assignment's integer sum of the header fields and
+             payload bytes (the default).  Cheap, but blind to swapped
+             bytes and to errors that cancel out
+   - inet:   the Internet checksum (RFC 1071), a ones' complement sum of
+             16 bit words, summed 8 words at a time with SSE2
+   - crc32c: CRC32C (Castagnoli), using the SSE4.2 crc32 instruction
+             when the CPU has it and an 8 way sliced table otherwise
+**********************************************************************/
+
+static int algorithm = CHECKSUM_SUM;   /* the algorithm used by ComputeChecksum() */
+
+static const char *names[] = { "sum", "inet", "crc32c" };
+#define NALGORITHMS ((int)(sizeof(names) / sizeof(names[0])))
+
+
+/********* CRC32C ************/
+
+#define CRC32C_POLY 0x82F63B78UL   /* reflected Castagnoli polynomial */
+
+static unsigned long crctable[8][256];  /* slicing by 8 tables, built on first use */
+static bool crcready = false;
+
+static void makecrctables(void)
+{
+  unsigned long crc;
+  int i, j;
+
+  for (i=0; i<256; i++) {
+    crc = (unsigned long)i;
+    for (j=0; j<8; j++)
+      crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+    crctable[0][i] = crc;
+  }
+  for (i=0; i<256; i++)
+    for (j=1; j<8; j++)
+      crctable[j][i] = (crctable[j-1][i] >> 8) ^ crctable[0][crctable[j-1][i] & 0xFF];
+  crcready = true;
+}
+
+/* table driven CRC32C, consuming 8 bytes per step */
+static unsigned long crc32c_table(unsigned long crc, const unsigned char *p, size_t len)
+{
+  unsigned long lo, hi;
+
+  if (!crcready)
+    makecrctables();
+  while (len >= 8) {
+    lo = crc ^ ((unsigned long)p[0] | (unsigned long)p[1] << 8 |
+                (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24);
+    hi = (unsigned long)p[4] | (unsigned long)p[5] << 8 |
+         (unsigned long)p[6] << 16 | (unsigned long)p[7] << 24;
+    crc = crctable[7][lo & 0xFF] ^ crctable[6][(lo >> 8) & 0xFF] ^
+          crctable[5][(lo >> 16) & 0xFF] ^ crctable[4][(lo >> 24) & 0xFF] ^
+          crctable[3][hi & 0xFF] ^ crctable[2][(hi >> 8) & 0xFF] ^
+          crctable[1][(hi >> 16) & 0xFF] ^ crctable[0][(hi >> 24) & 0xFF];
+    p += 8;
+    len -= 8;
+  }
+  while (len-- > 0)
+    crc = (crc >> 8) ^ crctable[0][(crc ^ *p++) & 0xFF];
+  return(crc);
+}
+
+#ifdef HAVE_SSE42
+/* CRC32C with the SSE4.2 crc32 instruction */
+__attribute__((target("sse4.2")))
+static unsigned long crc32c_sse42(unsigned long crc, const unsigned char *p, size_t len)
+{
+#if defined(__x86_64__)
+  unsigned long word;
+
+  while (len >= 8) {
+    memcpy(&word, p, 8);
+    crc = _mm_crc32_u64(crc, word);
+    p += 8;
+    len -= 8;
+  }
+#endif
+  while (len-- > 0)
+    crc = _mm_crc32_u8((unsigned int)crc, *p++);
+  return(crc);
+}
+#endif
+
+/* CRC32C of len bytes at buf, continuing from a previous crc (0 to start) */
+unsigned long crc32c(unsigned long crc, const void *buf, size_t len)
+{
+#ifdef HAVE_SSE42
+  static int sse42 = -1;
+
+  if (sse42 < 0)
+    sse42 = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+  if (sse42)
+    return(~crc32c_sse42(~crc & 0xFFFFFFFFUL, buf, len) & 0xFFFFFFFFUL);
+#endif
+  return(~crc32c_table(~crc & 0xFFFFFFFFUL, buf, len) & 0xFFFFFFFFUL);
+}
+
+
+/********* Internet checksum ************/
+
+/* add len bytes at p into a ones' complement sum of native 16 bit words.
+   Sums of 16 bit words are byte order independent (RFC 1071), so the
+   words are summed as they lie in memory and never swapped */
+static unsigned long inetsum(unsigned long sum, const unsigned char *p, size_t len)
+{
+  unsigned short word;
+#if defined(__SSE2__)
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc, v;
+  unsigned int lanes[4];
+  size_t blocks;
+
+  /* widen each 16 byte block to 32 bit lanes and add; fold the lanes into
+     sum before they can overflow (2^15 blocks add at most 2^32 - 2^17) */
+  while (len >= 16) {
+    acc = zero;
+    for (blocks = 0; len >= 16 && blocks < 32768; blocks++) {
+      v = _mm_loadu_si128((const __m128i *)p);
+      acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+      acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+      p += 16;
+      len -= 16;
+    }
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum += lanes[0] & 0xFFFF;
+    sum += lanes[0] >> 16;
+    sum += lanes[1] & 0xFFFF;
+    sum += lanes[1] >> 16;
+    sum += lanes[2] & 0xFFFF;
+    sum += lanes[2] >> 16;
+    sum += lanes[3] & 0xFFFF;
+    sum += lanes[3] >> 16;
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+#endif
+  while (len >= 2) {
+    memcpy(&word, p, 2);
+    sum += word;
+    p += 2;
+    len -= 2;
+    if (sum > 0xFFFFFFUL)
+      sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  if (len > 0) {
+    word = 0;
+    memcpy(&word, p, 1);
+    sum += word;
+  }
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  return(sum);
+}
+
+/* Internet checksum of len bytes at buf */
+unsigned int inetchecksum(const void *buf, size_t len)
+{
+  return((unsigned int)(~inetsum(0, buf, len) & 0xFFFF));
+}
+
+
+/********* Packet checksums ************/
+
+/* select the algorithm used by ComputeChecksum() by name.  Returns false
+   if there is no algorithm of that name */
+bool SelectChecksum(const char *name)
+{
+  int i;
+
+  for (i=0; i<NALGORITHMS; i++)
+    if (strcmp(names[i], name) == 0) {
+      algorithm = i;
+      return(true);
+    }
+  return(false);
+}
+
+/* the payload of a synthetic packet (a NULL payload, see emulator.h) is
+   length copies of its buffer's fill byte; these checksum it a block of
+   fill bytes at a time rather than materializing it */
+static unsigned long crc32cfill(unsigned long crc, int fill, int length)
+{
+  unsigned char block[256];
+
+  memset(block, fill, sizeof(block));
+  for (; length > (int)sizeof(block); length -= sizeof(block))
+    crc = crc32c(crc, block, sizeof(block));
+  return(crc32c(crc, block, length));
+}
+
+static unsigned long inetsumfill(unsigned long sum, int fill, int length)
+{
+  unsigned char block[256];
+
+  memset(block, fill, sizeof(block));
+  for (; length > (int)sizeof(block); length -= sizeof(block))
+    sum = inetsum(sum, block, sizeof(block));
+  return(inetsum(sum, block, length));
+}
+
+/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
+   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
+   original checksum.  This procedure must generate a different checksum to the original if
+   the packet is corrupted.
+*/
+int ComputeChecksum(struct pkt packet)
+{
+  unsigned char header[12];
+  unsigned long crc;
+  unsigned long sum;
+  unsigned int checksum = 0;
+  int i;
+
+  if (algorithm != CHECKSUM_SUM) {
+    /* the header fields in a fixed (little endian) byte order */
+    for (i=0; i<4; i++) {
+      header[i] = (unsigned char)((unsigned int)packet.seqnum >> (8 * i));
+      header[4 + i] = (unsigned char)((unsigned int)packet.acknum >> (8 * i));
+      header[8 + i] = (unsigned char)((unsigned int)packet.flags >> (8 * i));
+    }
+    if (algorithm == CHECKSUM_CRC32C) {
+      crc = crc32c(0, header, sizeof(header));
+      if (packet.payload == NULL && packet.length > 0)
+        return((int)crc32cfill(crc, packet.buf->fill, packet.length));
+      return((int)crc32c(crc, packet.payload, packet.length));
+    }
+    sum = inetsum(0, header, sizeof(header));
+    if (packet.payload == NULL && packet.length > 0)
+      sum = inetsumfill(sum, packet.buf->fill, packet.length);
+    else
+      sum = inetsum(sum, (unsigned char *)packet.payload, packet.length);
+    return((int)(~sum & 0xFFFF));
+  }
+
+  /* summed unsigned, as corrupted header fields can overflow an int */
+  checksum = (unsigned int)packet.seqnum;
+  checksum += (unsigned int)packet.acknum;
+  checksum += (unsigned int)packet.flags;
+  if (packet.payload == NULL && packet.length > 0)
+    checksum += (unsigned int)packet.length * (unsigned int)(int)(char)packet.buf->fill;
+  else
+    for ( i=0; i<packet.length; i++ )
+      checksum += (unsigned int)(int)(packet.payload[i]);
+
+  return (int)checksum;
+}
+
+bool IsCorrupted(struct pkt packet)
+{
+  if (packet.checksum == ComputeChecksum(packet))
+    return (false);
+  else
+    return (true);
+}
@@ -0,0 +1,22 @@
+/* packet checksums shared by the protocols */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* checksum algorithms, selected by name with SelectChecksum() */
+#define CHECKSUM_SUM     0   /* "sum": integer sum of header fields and payload bytes */
+#define CHECKSUM_INET    1   /* "inet": Internet checksum (RFC 1071) */
+#define CHECKSUM_CRC32C  2   /* "crc32c": CRC32C (Castagnoli) */
+
+/* select the checksum algorithm by name, false if there is none of that name */
+extern bool SelectChecksum(const char *);
+
+/* checksum of a packet's header fields and payload */
+extern int ComputeChecksum(struct pkt);
+
+/* true if a packet's checksum does not match its contents */
+extern bool IsCorrupted(struct pkt);
+
+/* checksums of a buffer: crc32c(previous crc or 0, buffer, length) */
+extern unsigned long crc32c(unsigned long, const void *, size_t);
+extern unsigned int inetchecksum(const void *, size_t);
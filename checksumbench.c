@@ -0,0 +1,80 @@
+#define _POSIX_C_SOURCE 199309L   /* clock_gettime() */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "emulator.h"
+#include "checksum.h"
+
+/* Compile Command: gcc -Wall -ansi -pedantic -O2 -o checksumbench checksumbench.c checksum.c
+   and with -DCRC32C_TABLE for CRC32C by the sliced table rather than the
+   SSE4.2 crc32 instruction */
+
+/* ******************************************************************
+   Checksum throughput benchmark: CRC32C and the Internet checksum of
+   buffers of each size, in GB/s on one core.
+
+   usage: ./checksumbench [size ...]
+     e.g. ./checksumbench 20 1500 65536
+**********************************************************************/
+
+#define MINTIME 0.2e9   /* nanoseconds each measurement runs for at least */
+
+static const size_t sizes[] = { 20, 64, 256, 1500, 4096, 65536 };
+#define NSIZES ((int)(sizeof(sizes) / sizeof(sizes[0])))
+
+static volatile unsigned long sink;   /* keeps the checksums from being optimised away */
+
+static double nanoseconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return(now.tv_sec * 1e9 + now.tv_nsec);
+}
+
+/* bytes checksummed per nanosecond (GB/s) by crc32c, or the Internet
+   checksum if inet, over a buffer of size bytes */
+static double throughput(const unsigned char *buf, size_t size, int inet)
+{
+  double start, elapsed;
+  long n = 0;
+  long i, batch;
+
+  batch = (long)(65536 / size) + 1;
+  start = nanoseconds();
+  do {
+    for (i=0; i<batch; i++)
+      sink += inet ? inetchecksum(buf, size) : crc32c(0, buf, size);
+    n += batch;
+    elapsed = nanoseconds() - start;
+  } while (elapsed < MINTIME);
+  return(n * (double)size / elapsed);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned char *buf;
+  long size;
+  int nsizes;
+  int i, j;
+
+  nsizes = argc > 1 ? argc - 1 : NSIZES;
+  printf("%8s %14s %10s\n", "size", "crc32c GB/s", "inet GB/s");
+  for (i=0; i<nsizes; i++) {
+    size = argc > 1 ? atol(argv[i + 1]) : (long)sizes[i];
+    if (size < 1) {
+      printf("sizes must be at least 1 byte\n");
+      exit(EXIT_FAILURE);
+    }
+    buf = malloc((size_t)size);
+    if (buf == NULL) {
+      printf("out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+    for (j=0; j<size; j++)
+      buf[j] = (unsigned char)rand();
+    printf("%8ld %14.2f %10.2f\n", size, throughput(buf, (size_t)size, 0), throughput(buf, (size_t)size, 1));
+    free(buf);
+  }
+  return(0);
+}
@@ -0,0 +1,104 @@
+#include "compress.h"
+
+/* ******************************************************************
+   PackBits run length coding (as in TIFF and Macintosh images).  The
+   compressed data is a sequence of runs, each a count byte n then:
+   - n 0 to 127:     n + 1 literal bytes
+   - n -1 to -127:   one byte, repeated 1 - n times
+   - n -128:         nothing (not produced)
+   Runs of 3 or more equal bytes are repeated, so incompressible data
+   grows by at most one byte in 128, and a message of one letter (the
+   emulator's messages) shrinks to 2 bytes per 128.
+**********************************************************************/
+
+#define MAXRUN 128
+
+int rle_compress(const char *in, int length, char *out)
+{
+  int i, run, literal;
+  int n = 0;
+
+  for (i=0; i<length; ) {
+    /* a run of equal bytes */
+    for (run=1; i+run<length && run<MAXRUN && in[i+run]==in[i]; run++)
+      ;
+    if (run >= 3) {
+      out[n++] = (char)(1 - run);
+      out[n++] = in[i];
+      i += run;
+      continue;
+    }
+
+    /* literal bytes, up to the next run of 3 */
+    for (literal=0; i+literal<length && literal<MAXRUN; literal++)
+      if (i+literal+2 < length && in[i+literal] == in[i+literal+1] && in[i+literal] == in[i+literal+2])
+        break;
+    out[n++] = (char)(literal - 1);
+    for (; literal>0; literal--)
+      out[n++] = in[i++];
+  }
+  return(n);
+}
+
+int rle_fill(char fill, int length, char *out)
+{
+  int n = 0;
+  int run;
+
+  for (; length>0; length-=run) {
+    run = length < MAXRUN ? length : MAXRUN;
+    if (run >= 3) {
+      out[n++] = (char)(1 - run);
+      out[n++] = fill;
+    }
+    else {
+      out[n++] = (char)(run - 1);
+      out[n++] = fill;
+      if (run == 2)
+        out[n++] = fill;
+    }
+  }
+  return(n);
+}
+
+int rle_length(const char *in, int length)
+{
+  int i, count;
+  int n = 0;
+
+  for (i=0; i<length; ) {
+    count = (signed char)in[i++];
+    if (count >= 0) {
+      if (i + count + 1 > length)
+        return(-1);
+      n += count + 1;
+      i += count + 1;
+    }
+    else if (count != -128) {
+      if (i >= length)
+        return(-1);
+      n += 1 - count;
+      i++;
+    }
+  }
+  return(n);
+}
+
+int rle_expand(const char *in, int length, char *out)
+{
+  int i, count;
+  int n = 0;
+
+  for (i=0; i<length; ) {
+    count = (signed char)in[i++];
+    if (count >= 0)
+      for (count++; count>0; count--)
+        out[n++] = in[i++];
+    else if (count != -128) {
+      for (count=1-count; count>0; count--)
+        out[n++] = in[i];
+      i++;
+    }
+  }
+  return(n);
+}
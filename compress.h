@@ -0,0 +1,18 @@
+/* message compression shared by the protocols: PackBits run length coding */
+
+/* the largest compressed size of (int) bytes */
+#define RLE_BOUND(n) ((n) + ((n) + 127) / 128)
+
+/* compress length (int) bytes into out, which has room for RLE_BOUND of */
+/* them, returning the compressed length.  rle_fill() compresses length  */
+/* bytes that are all fill (char)                                        */
+extern int rle_compress(const char *, int, char *);
+extern int rle_fill(char, int, char *);
+
+/* the length that length (int) bytes of compressed data expand to, or -1 */
+/* if they are not valid compressed data                                  */
+extern int rle_length(const char *, int);
+
+/* expand length (int) bytes of valid compressed data into out, returning */
+/* the expanded length                                                    */
+extern int rle_expand(const char *, int, char *);
@@ -0,0 +1,27 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "deadline.h"
+
+void deadline_init(struct deadline *d, double lifetime, int slots)
+{
+  d->lifetime = lifetime;
+  d->expires = NULL;
+  if (lifetime <= 0.0)
+    return;
+  d->expires = malloc(slots * sizeof(double));
+  if (d->expires == NULL) {
+    printf("memory allocation for deadlines failed.\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void deadline_start(struct deadline *d, int slot, double sent)
+{
+  d->expires[slot] = sent + d->lifetime;
+}
+
+bool deadline_expired(const struct deadline *d, int slot, double now)
+{
+  return((float)d->expires[slot] <= (float)now);
+}
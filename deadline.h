@@ -0,0 +1,21 @@
+/* Message deadlines (deadline=).  A message the receiver has not       */
+/* acked within the lifetime is abandoned by the sender.  Event times   */
+/* are floats, so expiry is decided at float precision                  */
+
+#include <stdbool.h>
+
+/* the time each window slot's message expires */
+struct deadline {
+  double lifetime;         /* time after which an unacked message is abandoned, 0 for never */
+  double *expires;         /* the time each slot's message expires, NULL for never */
+};
+
+/* start deadlines of a lifetime (double), 0 for none, for a window */
+/* ring of (int) slots                                               */
+extern void deadline_init(struct deadline *, double, int);
+
+/* a slot's (int) message was first sent or packed at a time (double) */
+extern void deadline_start(struct deadline *, int, double);
+
+/* whether a slot's (int) message has expired at a time (double) */
+extern bool deadline_expired(const struct deadline *, int, double);
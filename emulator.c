@@ -33,17 +33,76 @@
    soon as n packets are sent.
    - fixed C style to adhere to current programming style
 
+   Modifications:
+   - protocol parameters are read from name=value command line options
+   (e.g. "./arq protocol=sr windowsize=8 timeout=20") so that one binary
+   covers a whole parameter sweep.  The stdin prompts are unchanged.
+   - the protocol under test is a struct protocol (protocol.h), either
+   built in or loaded from a plugin, chosen with the protocol= option.
+   - checksum=sum|inet|crc32c selects the packet checksum (checksum.c).
+   - corruption=bits|burst replaces the 'Z'/999999 corruption with random
+   bit errors anywhere in the packet: bitflips= (default 1) distinct bits,
+   or a burst of burst= (default 16) bits whose first and last bits are
+   flipped.  Messages reaching tolayer5() are checked against the messages
+   the sender accepted, and the summary reports the corruptions that got
+   through undetected.  timing=1 reports the time spent in the protocol
+   per packet (see errorbench.sh).
+   - messages are msgsize= to maxmsgsize= bytes (default 20, uniformly
+   distributed when they differ) and packets carry up to mtu= bytes
+   (default 20).  Protocols fragment messages larger than the mtu.  The
+   summary reports the bytes of correct messages delivered and goodput.
+   - payloads live in reference counted buffers (struct pktbuf), written
+   once by layer 5 and shared by the packets in flight; a payload is
+   only copied when a shared one is corrupted.
+   - payload=synthetic sends messages as synthetic buffers that hold
+   only their fill letter.  Their bytes are materialized only when
+   something must read them (corruption, or reassembly mixing synthetic
+   and real fragments), which makes large messages nearly free.
+   - the summary reports the packets A sent per message it accepted, and
+   the average time from layer 5 to layer 5 of the messages delivered
+   (nagle= trades the one against the other).
+   - bandwidth= (bytes per time unit, default 0 for unlimited) makes each
+   link send one packet at a time, taking its header (16 bytes) and
+   payload over bandwidth to go on the wire before the usual delay.  The
+   summary reports the bytes each side sent on the wire, and the time
+   A's packets waited on average for the link to be free.
+   - protocols using forward error correction report the parity packets
+   sent and the packets repaired from them, next to the resends.
+   - gro= (default 0) coalesces packets arriving at an entity within gro
+   time units of the first, and so of each other, into one batch, handed
+   to the protocol's input_batch() when the first of them arrives (like
+   receive offload): no packet waits for the others.  Arrivals at the
+   other entity are not held up; any other event at the same entity ends
+   the batch.
+   - deadline= (default 0 for none) is the lifetime of a message.  Messages
+   that expired before they were delivered may be skipped without error,
+   and the summary reports the messages delivered within it and the
+   packets the sender abandoned rather than resend.
+   - streams= (default 1) sends messages round robin on that many streams
+   (struct msg), each checked for order on its own.  With more than one
+   the summary gives a histogram of each stream's message delays.
+   - a sender whose window changes during the run (cc=) sets send_window,
+   and the summary reports its average over the run and in each of up
+   to NWINDOWBINS equal intervals of it.
+
    ********************************************************************* */
+#define _POSIX_C_SOURCE 199309L   /* clock_gettime() */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <dlfcn.h>
 #include "emulator.h"
-#include "gbn.h"
+#include "protocol.h"
+#include "arq.h"
 
 struct event {
   float evtime;           /* event time */
   int evtype;             /* event type code */
   int eventity;           /* entity where event occurs */
   struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
+  struct event *batch;    /* the next packet of a FROM_LAYER3_BATCH */
   struct event *prev;
   struct event *next;
 };
@@ -54,6 +113,7 @@ struct event *evlist = NULL;   /* the event list */
 #define  TIMER_INTERRUPT 0  
 #define  FROM_LAYER5     1
 #define  FROM_LAYER3     2
+#define  FROM_LAYER3_BATCH 3   /* packets coalesced by gro= */
 
 #define  OFF             0
 #define  ON              1
@@ -66,6 +126,13 @@ int total_ACKs_received;
 int packets_resent;       /* count of the number of packets resent  */
 int new_ACKs;           /* count of the number of acks correctly received */
 int packets_received;  /* count of the packets received by receiver */
+int parity_sent;       /* count of the FEC parity packets sent */
+int packets_repaired;  /* count of the packets the receiver repaired from parity */
+int packets_abandoned; /* count of the packets the sender gave up on (deadline=) */
+int policy_switches;  /* count of the times a hybrid sender switched policy */
+int packets_detected;  /* count of the packets resent on time based loss detection (rack=) */
+int tail_probes;       /* count of the tail loss probes sent (rack=) */
+int send_window;       /* the sender's window now, 0 if it does not report it */
 
 /* statistics updated by emulator */
 static int packets_lost;  
@@ -76,7 +143,7 @@ static int messages_delivered;
 
 static int nsim = 0;              /* number of messages from 5 to 4 so far */ 
 static int nsimmax = 0;           /* number of msgs to generate, then stop */
-static float time = 0.000;
+static float simtime = 0.000;
 static float lossprob;            /* probability that a packet is dropped  */
 static float corruptprob;   /* probability that one bit is packet is flipped */
 static int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
@@ -84,6 +151,80 @@ static float lambda;        /* arrival rate of messages from layer 5 */
 static int   ntolayer3;           /* number sent into layer 3 */
 static int   nlost;               /* number lost in media */
 static int ncorrupt;              /* number corrupted by media*/
+static float channeltail[2];      /* arrival time of the last packet sent to A and to B */
+static float linkfree[2];         /* time the links from A and from B finish sending */
+static float bandwidth;           /* bytes per time unit a link sends, 0 for no limit */
+static double wirebytes[2];       /* bytes A and B sent on the wire, headers and payloads */
+static double queuewait[2];       /* time packets of A and of B waited for their link to be free */
+
+#define NWINDOWBINS 16   /* intervals of the run the sender's window is averaged over */
+static double windowbins[NWINDOWBINS];  /* send_window times the time it held, in each interval */
+static double windowwidth;        /* time units of an interval, doubled as the run outgrows them */
+
+/* corruption models, chosen with the corruption= option */
+#define CORRUPT_Z      0   /* 'Z' in the payload or 999999 in a header field */
+#define CORRUPT_BITS   1   /* bitflips random distinct bits */
+#define CORRUPT_BURST  2   /* a burst of burstlen bits */
+
+#define HDRBITS (4 * 32)   /* bits in the corruptible packet header: seqnum, acknum, checksum, flags */
+#define HDRBYTES (HDRBITS / 8)
+
+struct sentmsg {
+  char letter;                    /* the letter the message is filled with */
+  int length;
+  float time;                     /* time the sender accepted it */
+  int stream;
+};
+
+#define NDELAYS 10   /* message delay histogram buckets: under 5, 10, 20 ... 1280, and more */
+
+/* the messages of a stream delivered to layer 5 */
+struct streamstats {
+  int nchecked;                   /* next accepted message expected, or one before it */
+  int ncorrect;                   /* number of correct messages */
+  double delay;                   /* their total time from layer 5 to layer 5 */
+  int delays[NDELAYS];            /* histogram of those times */
+};
+
+static int corruptmode;           /* CORRUPT_ model */
+static int bitflips;              /* bits flipped by CORRUPT_BITS */
+static int burstlen;              /* length of a CORRUPT_BURST burst */
+static struct sentmsg *accepted; /* each message the sender accepted */
+static int naccepted;             /* number of messages the sender accepted */
+static int nstreams;              /* streams of messages, sent round robin */
+static struct streamstats *streams;  /* messages delivered, by stream */
+static int nundetected;           /* messages delivered to layer 5 that were not sent */
+static int timing;                /* report protocol processing time */
+static double protocolns;         /* time spent in protocol callbacks */
+static float gro;                 /* coalesce arrivals within this time, 0 for none */
+static int ngrobatches;           /* number of FROM_LAYER3_BATCH events */
+static int ngropackets;           /* number of packets in them */
+
+static int mtu;                   /* largest packet payload, in bytes */
+static int msgsize;               /* length of messages from layer 5 ... */
+static int maxmsgsize;            /* ... up to this length */
+static double bytes_delivered;    /* bytes of the correct messages delivered to layer 5 */
+static double delay;              /* total time from layer 5 to layer 5 of the correct messages */
+static int ncorrect;              /* number of them */
+static double deadline;           /* lifetime of a message, 0 for unlimited */
+static int nontime;               /* correct messages delivered within it */
+static int ndatapackets;          /* packets sent by A */
+static int synthetic;             /* messages are synthetic buffers */
+
+/* byte i of data in buf, which is NULL for a synthetic buffer */
+#define PAYLOADBYTE(data, buf, i) ((data) != NULL ? (data)[i] : (char)(buf)->fill)
+
+static int noptions;              /* number of name=value command line options */
+static char **options;            /* the name=value command line options */
+
+/* the protocols built into the emulator, selected by name with protocol= */
+static const struct protocol *builtins[] = {
+  &gbn_protocol, &gbnb_protocol, &sr_protocol, &srt_protocol, &abp_protocol, &hybrid_protocol
+};
+#define NBUILTINS ((int)(sizeof(builtins) / sizeof(builtins[0])))
+
+static const struct protocol *protocol;  /* the protocol under test */
+static void *protocolctx;                /* its context, returned by its init() */
 
 /****************************************************************************/
 /* jimsrand(): return a double in range [0,1].  The routine below is used to */
@@ -104,43 +245,39 @@ double jimsrand(void)
 /*  The next set of routines handle the event list   */
 /*****************************************************/
 
-void insertevent(struct event *p)
+/* merge a chain of events, linked by next in time order, into the event */
+/* list in one pass.  Each goes before the events of its time already     */
+/* there                                                                  */
+static void splice(struct event *chain)
 {
-  struct event *q,*qold;
+  struct event *p, *q, *qold = NULL;
 
-  if (TRACE>2) {
-    printf("            INSERTEVENT: time is %f\n",time);
-    printf("            INSERTEVENT: future time will be %f\n",p->evtime); 
-  }
-  q = evlist;     /* q points to front of list in which p struct inserted */
-  if (q==NULL) {   /* list is empty */
-    evlist=p;
-    p->next=NULL;
-    p->prev=NULL;
-  }
-  else {
-    for (qold = q; q !=NULL && p->evtime > q->evtime; q=q->next)
+  for (q = evlist; chain != NULL; qold = p) {
+    p = chain;
+    chain = chain->next;
+    if (TRACE>2) {
+      printf("            INSERTEVENT: time is %f\n",simtime);
+      printf("            INSERTEVENT: future time will be %f\n",p->evtime); 
+    }
+    for (; q !=NULL && p->evtime > q->evtime; q=q->next)
       qold=q; 
-    if (q==NULL) {   /* end of list */
+    p->prev = qold;   /* insert between qold and q */
+    p->next = q;
+    if (qold != NULL)
       qold->next = p;
-      p->prev = qold;
-      p->next = NULL;
-    }
-    else if (q==evlist) { /* front of list */
-      p->next=evlist;
-      p->prev=NULL;
-      p->next->prev=p;
+    else
       evlist = p;
-    }
-    else {     /* middle of list */
-      p->next=q;
-      p->prev=q->prev;
-      q->prev->next=p;
-      q->prev=p;
-    }
+    if (q != NULL)
+      q->prev = p;
   }
 }
 
+void insertevent(struct event *p)
+{
+  p->next = NULL;
+  splice(p);
+}
+
 void generate_next_arrival(void)
 {
   double x;
@@ -156,7 +293,7 @@ void generate_next_arrival(void)
     printf("memory allocation for event failed.");
     exit(EXIT_FAILURE);
   }
-  evptr->evtime =  time + x;
+  evptr->evtime =  simtime + x;
   evptr->evtype =  FROM_LAYER5;
   if (BIDIRECTIONAL && (jimsrand()>0.5) )
     evptr->eventity = B;
@@ -196,6 +333,62 @@ void init(void)                         /* initialize the simulator */
   printf("Enter TRACE:");
   scanf("%d",&TRACE);
 
+  /* the corruption model, and a record of the messages sent to check deliveries against */
+  if (strcmp(getstringoption("corruption", "z"), "z") == 0)
+    corruptmode = CORRUPT_Z;
+  else if (strcmp(getstringoption("corruption", "z"), "bits") == 0)
+    corruptmode = CORRUPT_BITS;
+  else if (strcmp(getstringoption("corruption", "z"), "burst") == 0)
+    corruptmode = CORRUPT_BURST;
+  else {
+    printf("corruption must be z, bits or burst\n");
+    exit(EXIT_FAILURE);
+  }
+  bitflips = getintoption("bitflips", 1);
+  burstlen = getintoption("burst", 16);
+  if (bitflips < 1 || bitflips > HDRBITS || burstlen < 2 || burstlen > HDRBITS) {
+    printf("corruption needs 1 <= bitflips <= %d and 2 <= burst <= %d\n", HDRBITS, HDRBITS);
+    exit(EXIT_FAILURE);
+  }
+  timing = getoption("timing", 0) != 0;
+  gro = (float)getoption("gro", 0);
+  bandwidth = (float)getoption("bandwidth", 0);
+  deadline = getoption("deadline", 0);
+  if (gro < 0.0 || bandwidth < 0.0 || deadline < 0.0) {
+    printf("gro, bandwidth and deadline must be >= 0\n");
+    exit(EXIT_FAILURE);
+  }
+  if (strcmp(getstringoption("payload", "data"), "synthetic") == 0)
+    synthetic = 1;
+  else if (strcmp(getstringoption("payload", "data"), "data") != 0) {
+    printf("payload must be data or synthetic\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* packet and message sizes */
+  mtu = getintoption("mtu", 20);
+  msgsize = getintoption("msgsize", 20);
+  maxmsgsize = getintoption("maxmsgsize", msgsize);
+  if (mtu < 1 || msgsize < 1 || maxmsgsize < msgsize) {
+    printf("sizes need mtu >= 1 and 1 <= msgsize <= maxmsgsize\n");
+    exit(EXIT_FAILURE);
+  }
+  nstreams = getintoption("streams", 1);
+  if (nstreams < 1 || nstreams > MAXSTREAMS) {
+    printf("streams needs 1 <= streams <= %d\n", MAXSTREAMS);
+    exit(EXIT_FAILURE);
+  }
+  streams = calloc(nstreams, sizeof(struct streamstats));
+  if (streams == NULL) {
+    printf("memory allocation for streams failed.");
+    exit(EXIT_FAILURE);
+  }
+  accepted = malloc((nsimmax > 0 ? nsimmax : 1) * sizeof(struct sentmsg));
+  if (accepted == NULL) {
+    printf("memory allocation for messages failed.");
+    exit(EXIT_FAILURE);
+  }
+
 
   srand(9999);              /* init random number generator */
   sum = 0.0;                /* test random number generator for students */
@@ -215,22 +408,215 @@ void init(void)                         /* initialize the simulator */
   packets_resent = 0;
   new_ACKs = 0;
   packets_received = 0;
+  parity_sent = 0;
+  packets_repaired = 0;
+  packets_abandoned = 0;
+  policy_switches = 0;
+  packets_detected = 0;
+  tail_probes = 0;
+  send_window = 0;
   packets_lost = 0;  
   packets_corrupt = 0;
   packets_sent = 0;
   packets_timeout = 0;
   messages_delivered = 0;
+  naccepted = 0;
+  nundetected = 0;
+  bytes_delivered = 0.0;
+  delay = 0.0;
+  ncorrect = 0;
+  nontime = 0;
+  ndatapackets = 0;
+  protocolns = 0.0;
+  ngrobatches = 0;
+  ngropackets = 0;
 
   ntolayer3 = 0;
   nlost = 0;
   ncorrupt = 0;
+  channeltail[A] = channeltail[B] = 0.0;
+  linkfree[A] = linkfree[B] = 0.0;
+  wirebytes[A] = wirebytes[B] = 0.0;
+  queuewait[A] = queuewait[B] = 0.0;
+  for (i=0; i<NWINDOWBINS; i++)
+    windowbins[i] = 0.0;
+  windowwidth = 1.0;
 
-  time=0.0;                    /* initialize time to 0.0 */
+  simtime=0.0;                 /* initialize time to 0.0 */
   generate_next_arrival();     /* initialize event list */
 }
 
+/* add send_window over the time from simtime to time to the intervals  */
+/* it held in.  When time passes the last interval they are merged in    */
+/* pairs, so up to NWINDOWBINS intervals always cover the run so far.    */
+static void windowtime(double time)
+{
+  double t, end;
+  int i;
+
+  for (t=simtime; t<time; t=end) {
+    while (t >= NWINDOWBINS * windowwidth) {
+      for (i=0; i<NWINDOWBINS/2; i++)
+        windowbins[i] = windowbins[2*i] + windowbins[2*i+1];
+      for (; i<NWINDOWBINS; i++)
+        windowbins[i] = 0.0;
+      windowwidth *= 2.0;
+    }
+    i = (int)(t / windowwidth);
+    end = (i + 1) * windowwidth < time ? (i + 1) * windowwidth : time;
+    windowbins[i] += send_window * (end - t);
+  }
+}
+
+/* gro: gather the packets arriving at first's entity within gro of it,  */
+/* up to the next other event there, into a FROM_LAYER3_BATCH that is    */
+/* delivered now, at the time of the first.  It stays a FROM_LAYER3 if   */
+/* no other packets arrive in time.                                      */
+static void coalesce(struct event *first)
+{
+  struct event *q, *next, *last;
+
+  last = first;
+  for (q = evlist; q != NULL && q->evtime <= first->evtime + gro; q = next) {
+    next = q->next;
+    if (q->eventity != first->eventity)
+      continue;
+    if (q->evtype != FROM_LAYER3)
+      break;
+    if (q->prev != NULL)          /* remove q from the event list */
+      q->prev->next = q->next;
+    else
+      evlist = q->next;
+    if (q->next != NULL)
+      q->next->prev = q->prev;
+    last->batch = q;
+    last = q;
+  }
+  if (last == first)
+    return;
+  last->batch = NULL;
+  first->evtype = FROM_LAYER3_BATCH;
+}
+
 /********************** Student-callable ROUTINES ***********************/
 
+/* a new buffer of size bytes holding one reference.  The data is kept */
+/* just after the buffer                                               */
+struct pktbuf *pktbuf_alloc(int size)
+{
+  struct pktbuf *buf = malloc(sizeof(struct pktbuf) + size);
+
+  if (buf == NULL) {
+    printf("memory allocation for packet buffer failed.");
+    exit(EXIT_FAILURE);
+  }
+  buf->refs = 1;
+  buf->size = size;
+  buf->data = (char *)(buf + 1);
+  buf->fill = -1;
+  return(buf);
+}
+
+/* a synthetic buffer of size bytes of fill, holding one reference */
+static struct pktbuf *pktbuf_synthetic(int size, char fill)
+{
+  struct pktbuf *buf = pktbuf_alloc(0);
+
+  buf->size = size;
+  buf->data = NULL;
+  buf->fill = (unsigned char)fill;
+  return(buf);
+}
+
+/* the data of a buffer.  A synthetic buffer's data is made on first use */
+char *pktbuf_data(struct pktbuf *buf)
+{
+  if (buf->data == NULL) {
+    buf->data = malloc(buf->size > 0 ? buf->size : 1);
+    if (buf->data == NULL) {
+      printf("memory allocation for packet buffer failed.");
+      exit(EXIT_FAILURE);
+    }
+    memset(buf->data, buf->fill, buf->size);
+  }
+  return(buf->data);
+}
+
+/* take another reference to a buffer */
+struct pktbuf *pktbuf_hold(struct pktbuf *buf)
+{
+  buf->refs++;
+  return(buf);
+}
+
+/* drop a reference to a buffer, freeing it when none are left */
+void pktbuf_release(struct pktbuf *buf)
+{
+  if (buf != NULL && --buf->refs == 0) {
+    if (buf->data != (char *)(buf + 1))
+      free(buf->data);   /* materialized synthetic data */
+    free(buf);
+  }
+}
+
+/* find the value of a name=value command line option, NULL if not given */
+static const char *findoption(const char *name)
+{
+  size_t len = strlen(name);
+  int i;
+
+  for (i=0; i<noptions; i++)
+    if (strncmp(options[i], name, len) == 0 && options[i][len] == '=')
+      return(options[i] + len + 1);
+  return(NULL);
+}
+
+/* look up a numeric name=value command line option.  Returns dflt if the */
+/* option was not given on the command line                               */
+double getoption(const char *name, double dflt)
+{
+  const char *value = findoption(name);
+  char *end;
+  double x;
+
+  if (value == NULL)
+    return(dflt);
+  x = strtod(value, &end);
+  if (end == value || *end != '\0') {
+    printf("Invalid value for option %s: %s\n", name, value);
+    exit(EXIT_FAILURE);
+  }
+  return(x);
+}
+
+/* look up an integer name=value command line option.  Returns dflt if  */
+/* the option was not given on the command line                         */
+int getintoption(const char *name, int dflt)
+{
+  double x = getoption(name, dflt);
+
+  if (x < INT_MIN || x > INT_MAX || x != (double)(long)x) {
+    printf("Invalid value for option %s: %s, expected an integer\n", name, findoption(name));
+    exit(EXIT_FAILURE);
+  }
+  return((int)x);
+}
+
+/* look up a string name=value command line option.  Returns dflt if the */
+/* option was not given on the command line                              */
+const char *getstringoption(const char *name, const char *dflt)
+{
+  const char *value = findoption(name);
+
+  return(value != NULL ? value : dflt);
+}
+
+/* the current simulation time */
+double gettime(void)
+{
+  return(simtime);
+}
+
 /* called by students routine to cancel a previously-started timer */
 void stoptimer(int AorB)
 /* A or B is trying to stop timer */
@@ -238,7 +624,7 @@ void stoptimer(int AorB)
   struct event *q;
 
   if (TRACE>1)
-    printf("          STOP TIMER: stopping timer at %f\n",time);
+    printf("          STOP TIMER: stopping timer at %f\n",simtime);
   /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
   for (q=evlist; q!=NULL ; q = q->next) 
     if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
@@ -270,7 +656,7 @@ void starttimer(int AorB, double increment)
   struct event *evptr;
 
   if (TRACE>1)
-    printf("          START TIMER: starting timer at %f\n",time);
+    printf("          START TIMER: starting timer at %f\n",simtime);
   /* be nice: check to see if timer is already started, if so, then  warn */
   /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
   for (q=evlist; q!=NULL ; q = q->next)  
@@ -285,7 +671,7 @@ void starttimer(int AorB, double increment)
     printf("memory allocation for event failed.");
     exit(EXIT_FAILURE);
   }
-  evptr->evtime =  time + increment;
+  evptr->evtime =  simtime + increment;
   evptr->evtype =  TIMER_INTERRUPT;
    
  
@@ -294,42 +680,154 @@ void starttimer(int AorB, double increment)
 } 
 
 
+/* a monotonic clock in nanoseconds, for timing=1 */
+static double nanoseconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return(now.tv_sec * 1e9 + now.tv_nsec);
+}
+
+/* the payload of a packet in flight, for corrupting it.  A payload still */
+/* shared with the sender, or a synthetic one, is copied first            */
+static char *writablepayload(struct pkt *packet)
+{
+  struct pktbuf *buf;
+  int i;
+
+  if (packet->buf->refs > 1 || packet->payload == NULL) {
+    buf = pktbuf_alloc(packet->length);
+    for (i=0; i<packet->length; i++)
+      buf->data[i] = PAYLOADBYTE(packet->payload, packet->buf, i);
+    pktbuf_release(packet->buf);
+    packet->buf = buf;
+    packet->payload = buf->data;
+  }
+  return(packet->payload);
+}
+
+/* flip bit number bit of a packet.  The header fields come first, */
+/* least significant bit first, then the payload                   */
+static void flipbit(struct pkt *packet, int bit)
+{
+  int *field[4];
+  char *payload;
+
+  if (bit < HDRBITS) {
+    field[0] = &packet->seqnum;
+    field[1] = &packet->acknum;
+    field[2] = &packet->checksum;
+    field[3] = &packet->flags;
+    *field[bit / 32] = (int)((unsigned int)*field[bit / 32] ^ (1U << (bit % 32)));
+  }
+  else {
+    bit -= HDRBITS;
+    payload = writablepayload(packet);
+    payload[bit / 8] = (char)((unsigned char)payload[bit / 8] ^ (1 << (bit % 8)));
+  }
+}
+
+/* corrupt a packet according to the corruption model */
+static void corrupt(struct pkt *packet)
+{
+  int flipped[HDRBITS];
+  int nbits = HDRBITS + 8 * packet->length;
+  float x;
+  int bit, first, i, j;
+
+  switch (corruptmode) {
+  case CORRUPT_BITS:
+    /* bitflips distinct bits, anywhere in the packet */
+    for (i=0; i<bitflips; i++) {
+      do {
+        bit = (int)(jimsrand() * nbits) % nbits;
+        for (j=0; j<i && flipped[j] != bit; j++)
+          ;
+      } while (j < i);
+      flipped[i] = bit;
+      flipbit(packet, bit);
+    }
+    break;
+  case CORRUPT_BURST:
+    /* a burst of burstlen bits: the first and last are flipped, the ones between at random */
+    first = (int)(jimsrand() * (nbits - burstlen + 1)) % (nbits - burstlen + 1);
+    flipbit(packet, first);
+    for (i=1; i<burstlen-1; i++)
+      if (jimsrand() < 0.5)
+        flipbit(packet, first + i);
+    flipbit(packet, first + burstlen - 1);
+    break;
+  default:
+    if ( (x = jimsrand()) < .75) {
+      if (packet->length > 0)
+        writablepayload(packet)[0]='Z';   /* corrupt payload */
+      else
+        packet->acknum = 999999;  /* no payload, corrupt the header */
+    }
+    else if (x < .875)
+      packet->seqnum = 999999;
+    else
+      packet->acknum = 999999;
+  }
+}
+
 /************************** TOLAYER3 ***************/
-void tolayer3(int AorB, struct pkt packet)
-/* A or B is sending to network  */
+/* A or B is sending a packet to network.  Returns the arrival event, for  */
+/* the event list, or NULL if the packet is lost                           */
+static struct event *transmit(int AorB, struct pkt packet)
 {
   struct pkt *mypktptr;
-  struct event *evptr,*q;
-  float lastime, x;
+  struct event *evptr;
+  float lastime;
   int i;
 
   ntolayer3++;
+  if (AorB == A)
+    ndatapackets++;
+  if (packet.length < 0 || packet.length > mtu) {
+    printf("TOLAYER3: packet length %d is not 0 to the mtu of %d\n", packet.length, mtu);
+    exit(EXIT_FAILURE);
+  }
+
+  /* the packet goes on the wire, which sends one at a time at bandwidth= */
+  wirebytes[AorB] += HDRBYTES + packet.length;
+  if (bandwidth > 0.0) {
+    if (linkfree[AorB] > simtime)
+      queuewait[AorB] += linkfree[AorB] - simtime;
+    linkfree[AorB] = (linkfree[AorB] > simtime ? linkfree[AorB] : simtime) + (HDRBYTES + packet.length) / bandwidth;
+  }
 
   /* simulate losses: */
   if (jimsrand() < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
     nlost++;
     if (TRACE>0)    
       printf("          TOLAYER3: packet being lost\n");
-    return;
+    return(NULL);
   }  
 
   /* make a copy of the packet student just gave me since he/she may decide */
-  /* to do something with the packet after we return back to him/her */ 
+  /* to do something with the packet after we return back to him/her.  The */
+  /* payload is shared if it is in a buffer, copied into one if not */
   mypktptr = malloc(sizeof(struct pkt));
   if (mypktptr == 0) {
     printf("memory allocation for event failed.");
     exit(EXIT_FAILURE);
   }
-  mypktptr->seqnum = packet.seqnum;
-  mypktptr->acknum = packet.acknum;
-  mypktptr->checksum = packet.checksum;
-  for (i=0; i<20; i++)
-    mypktptr->payload[i] = packet.payload[i];
+  *mypktptr = packet;
+  if (packet.buf != NULL)
+    pktbuf_hold(packet.buf);
+  else if (packet.length > 0) {
+    mypktptr->buf = pktbuf_alloc(packet.length);
+    mypktptr->payload = mypktptr->buf->data;
+    for (i=0; i<packet.length; i++)
+      mypktptr->payload[i] = packet.payload[i];
+  }
   if (TRACE>2)  {
     printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
            mypktptr->acknum,  mypktptr->checksum);
-    for (i=0; i<20; i++)
-      printf("%c",mypktptr->payload[i]);
+    for (i=0; i<packet.length; i++)
+      printf("%c",PAYLOADBYTE(mypktptr->payload, mypktptr->buf, i));
     printf("\n");
   }
 
@@ -346,60 +844,215 @@ void tolayer3(int AorB, struct pkt packet)
      medium can not reorder, so make sure packet arrives between 1 and 10
      time units after the latest arrival time of packets
      currently in the medium on their way to the destination */
-  lastime = time;
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) ) 
-      lastime = q->evtime;
+  lastime = bandwidth > 0.0 ? linkfree[AorB] : simtime;
+  if (channeltail[evptr->eventity] > lastime)
+    lastime = channeltail[evptr->eventity];
   evptr->evtime =  lastime + 1 + 9*jimsrand();
+  channeltail[evptr->eventity] = evptr->evtime;
  
 
 
   /* simulate corruption: */
   if ((jimsrand() < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
     ncorrupt++;
-    if ( (x = jimsrand()) < .75)
-      mypktptr->payload[0]='Z';   /* corrupt payload */
-    else if (x < .875)
-      mypktptr->seqnum = 999999;
-    else
-      mypktptr->acknum = 999999;
+    corrupt(mypktptr);
     if (TRACE>0)    
       printf("          TOLAYER3: packet being corrupted\n");
   }  
 
   if (TRACE>2)  
     printf("          TOLAYER3: scheduling arrival on other side\n");
-  insertevent(evptr);
+  return(evptr);
 } 
 
-void tolayer5(int AorB, char datasent[20])
+void tolayer3(int AorB, struct pkt packet)
 {
-  int i;  
-  if (TRACE>2) {
-    printf("          TOLAYER5: data received by application at ");
-    if (AorB == A) 
-      printf("A: ");
+  struct event *evptr;
+
+  if ((evptr = transmit(AorB, packet)) != NULL)
+    insertevent(evptr);
+}
+
+/* the channel decides the fate of each of n packets in order, as n calls */
+/* to tolayer3() would.  The channel does not reorder, so the arrivals    */
+/* are in time order: they are chained and spliced into the event list    */
+/* in one pass, rather than each searched for from the front              */
+void tolayer3_batch(int AorB, struct pkt packets[], int n)
+{
+  struct event *chain = NULL, *last = NULL, *evptr;
+  int i;
+
+  for (i=0; i<n; i++) {
+    if ((evptr = transmit(AorB, packets[i])) == NULL)
+      continue;
+    evptr->next = NULL;
+    if (last != NULL)
+      last->next = evptr;
     else
-      printf("B: ");
-    for (i=0; i<20; i++)  
-      printf("%c",datasent[i]);
-    printf("\n");
+      chain = evptr;
+    last = evptr;
+  }
+  splice(chain);
+}
+
+/* the first message accepted at or after k on stream, or naccepted (or */
+/* k if it is beyond that) if there is none                             */
+static int nextaccepted(int stream, int k)
+{
+  while (k < naccepted && accepted[k].stream != stream)
+    k++;
+  return(k);
+}
+
+/* check a message delivered to layer 5 against the next one the sender */
+/* accepted on its stream.  A message that was sent but is not the next */
+/* one (a duplicate, or out of order) is an error too; resynchronise on */
+/* it if it is further on                                               */
+static void checkmessage(struct msg *message)
+{
+  struct streamstats *st;
+  double elapsed;
+  char first;
+  int i, j, k, bucket;
+
+  if (message->stream < 0 || message->stream >= nstreams) {
+    nundetected++;
+    if (TRACE>0)
+      printf("          TOLAYER5: message on stream %d, which does not exist\n", message->stream);
+    return;
+  }
+  st = &streams[message->stream];
+  first = message->length > 0 ? PAYLOADBYTE(message->data, message->buf, 0) : 0;
+  for (i=0; i<message->length && PAYLOADBYTE(message->data, message->buf, i) == first; i++)
+    ;
+
+  /* with deadline= the messages the sender abandoned are skipped.  It   */
+  /* abandons them at its own events, and letters repeat, so an entry    */
+  /* that has not yet expired here may be gone too: search on for it     */
+  k = nextaccepted(message->stream, st->nchecked);
+  if (deadline > 0.0 && i == message->length) {
+    for (j=k; j<naccepted && (message->length != accepted[j].length || first != accepted[j].letter);
+         j=nextaccepted(message->stream, j + 1))
+      ;
+    if (j < naccepted)
+      k = j;
+  }
+  st->nchecked = k;
+  if (k < naccepted && i == message->length && message->length == accepted[k].length &&
+      first == accepted[k].letter) {
+    elapsed = simtime - accepted[k].time;
+    bytes_delivered += message->length;
+    if (elapsed <= deadline)
+      nontime++;
+    delay += elapsed;
+    ncorrect++;
+    st->nchecked = k + 1;
+    st->delay += elapsed;
+    st->ncorrect++;
+    for (bucket=0; bucket<NDELAYS-1 && elapsed >= 5.0 * (1 << bucket); bucket++)
+      ;
+    st->delays[bucket]++;
+    return;
+  }
+  nundetected++;
+  if (TRACE>0)
+    printf("          TOLAYER5: message was corrupted\n");
+  if (message->length == 0 || i < message->length) {
+    st->nchecked = k + 1;
+    return;
+  }
+  for (i=k; i<naccepted && accepted[i].letter != first; i=nextaccepted(message->stream, i + 1))
+    ;
+  if (i < naccepted)
+    st->nchecked = i + 1;
+}
+
+void tolayer5(int AorB, struct msg message)
+{
+  tolayer5_batch(AorB, &message, 1);
+}
+
+/* deliver n messages in order, as n calls to tolayer5() would */
+void tolayer5_batch(int AorB, struct msg messages[], int n)
+{
+  int i, j;
+
+  messages_delivered += n;
+  for (j=0; j<n; j++) {
+    if (TRACE>2) {
+      printf("          TOLAYER5: data received by application at ");
+      if (AorB == A) 
+        printf("A: ");
+      else
+        printf("B: ");
+      for (i=0; i<messages[j].length; i++)  
+        printf("%c",PAYLOADBYTE(messages[j].data, messages[j].buf, i));
+      printf("\n");
+    }
+    checkmessage(&messages[j]);
+  }
+}
+
+/* find the protocol named by the protocol= option: one built into the */
+/* emulator, or else a plugin loaded from the shared object at that path */
+const struct protocol *loadprotocol(const char *name)
+{
+  const struct protocol **entry;
+  void *handle;
+  int i;
+
+  for (i=0; i<NBUILTINS; i++)
+    if (strcmp(builtins[i]->name, name) == 0)
+      return(builtins[i]);
+
+  if (strchr(name, '/') == NULL) {
+    printf("Unknown protocol %s, choose one of:", name);
+    for (i=0; i<NBUILTINS; i++)
+      printf(" %s", builtins[i]->name);
+    printf(" or the path of a plugin, e.g. ./%s.so\n", name);
+    exit(EXIT_FAILURE);
+  }
+  handle = dlopen(name, RTLD_NOW);
+  if (handle == NULL) {
+    printf("Cannot load protocol plugin: %s\n", dlerror());
+    exit(EXIT_FAILURE);
+  }
+  entry = dlsym(handle, "protocol_plugin");
+  if (entry == NULL || *entry == NULL) {
+    printf("%s is not a protocol plugin: it has no protocol_plugin entry point\n", name);
+    exit(EXIT_FAILURE);
+  }
+  if ((*entry)->abi_version < PROTOCOL_ABI_OLDEST || (*entry)->abi_version > PROTOCOL_ABI_VERSION) {
+    printf("Protocol plugin %s has interface version %d, this emulator supports %d to %d\n",
+           name, (*entry)->abi_version, PROTOCOL_ABI_OLDEST, PROTOCOL_ABI_VERSION);
+    exit(EXIT_FAILURE);
   }
-  messages_delivered++;
+  return(*entry);
 }
 
-int main(void)
+int main(int argc, char *argv[])
 {
   struct event *eventptr;
   struct msg  msg2give;
   struct pkt  pkt2give;
-   
-  int i,j;
+  struct pkt *pkts2give;
+  struct event *q, *next;
+  double start = 0.0;
+  char label[16];
+  double sum;
+  int i,j,n,full;
+
+  for (i=1; i<argc; i++)
+    if (strchr(argv[i], '=') == NULL) {
+      printf("usage: %s [name=value ...]\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  noptions = argc - 1;
+  options = argv + 1;
   
+  protocol = loadprotocol(getstringoption("protocol", "gbn"));
   init();
-  A_init();
-  B_init();
+  protocolctx = protocol->init();
    
   while (1) {
     eventptr = evlist;            /* get next event to simulate */
@@ -408,6 +1061,8 @@ int main(void)
     evlist = evlist->next;        /* remove this event from event list */
     if (evlist!=NULL)
       evlist->prev=NULL;
+    if (eventptr->evtype == FROM_LAYER3 && gro > 0.0)
+      coalesce(eventptr);
     if (TRACE>=2) {
       printf("\nEVENT time: %f,",eventptr->evtime);
       printf("  type: %d",eventptr->evtype);
@@ -415,50 +1070,105 @@ int main(void)
         printf(", timerinterrupt  ");
       else if (eventptr->evtype==1)
         printf(", fromlayer5 ");
+      else if (eventptr->evtype==FROM_LAYER3_BATCH)
+        printf(", fromlayer3 batch ");
       else
         printf(", fromlayer3 ");
       printf(" entity: %d\n",eventptr->eventity);
     }
-    time = eventptr->evtime;        /* update time to next event time */
+    windowtime(eventptr->evtime);
+    simtime = eventptr->evtime;        /* update time to next event time */
     if (eventptr->evtype == FROM_LAYER5 ) {
       if (nsim < nsimmax) {
         generate_next_arrival();   /* set up future arrival */
         /* fill in msg to give with string of same letter */    
         j = nsim % 26; 
-        for (i=0; i<20; i++)  
-          msg2give.data[i] = 97 + j;
+        msg2give.stream = nsim % nstreams;
+        msg2give.length = msgsize;
+        if (maxmsgsize > msgsize)
+          msg2give.length += (int)(jimsrand() * (maxmsgsize - msgsize + 1)) % (maxmsgsize - msgsize + 1);
+        if (synthetic) {
+          msg2give.buf = pktbuf_synthetic(msg2give.length, (char)(97 + j));
+          msg2give.data = NULL;
+        }
+        else {
+          msg2give.buf = pktbuf_alloc(msg2give.length);
+          msg2give.data = msg2give.buf->data;
+          for (i=0; i<msg2give.length; i++)  
+            msg2give.data[i] = 97 + j;
+        }
         if (TRACE>2) {
           printf("          MAINLOOP: data given to student: ");
-          for (i=0; i<20; i++) 
-            printf("%c", msg2give.data[i]);
+          for (i=0; i<msg2give.length; i++) 
+            printf("%c", PAYLOADBYTE(msg2give.data, msg2give.buf, i));
           printf("\n");
         }
         nsim++;
-        if (eventptr->eventity == A) 
-          A_output(msg2give);  
-        else
-          B_output(msg2give);  
+        full = window_full;
+        if (timing)
+          start = nanoseconds();
+        protocol->output(protocolctx, eventptr->eventity, msg2give);
+        if (timing)
+          protocolns += nanoseconds() - start;
+        if (window_full == full) {   /* not dropped by the sender */
+          accepted[naccepted].letter = (char)(97 + j);
+          accepted[naccepted].time = simtime;
+          accepted[naccepted].stream = msg2give.stream;
+          accepted[naccepted++].length = msg2give.length;
+        }
+        pktbuf_release(msg2give.buf);
       }
       else if (TRACE > 2)
           printf("          FROM_LAYER5: no more messages to send: \n");
     }
     else if (eventptr->evtype ==  FROM_LAYER3) {
-      pkt2give.seqnum = eventptr->pktptr->seqnum;
-      pkt2give.acknum = eventptr->pktptr->acknum;
-      pkt2give.checksum = eventptr->pktptr->checksum;
-      for (i=0; i<20; i++)  
-        pkt2give.payload[i] = eventptr->pktptr->payload[i];
-	    if (eventptr->eventity ==A)      /* deliver packet by calling */
-        A_input(pkt2give);            /* appropriate entity */
-      else
-        B_input(pkt2give);
+      pkt2give = *eventptr->pktptr;
+      /* deliver packet to the appropriate entity */
+      if (timing)
+        start = nanoseconds();
+      protocol->input(protocolctx, eventptr->eventity, pkt2give);
+      if (timing)
+        protocolns += nanoseconds() - start;
+      pktbuf_release(eventptr->pktptr->buf);
 	    free(eventptr->pktptr);          /* free the memory for packet */
     }
-    else if (eventptr->evtype ==  TIMER_INTERRUPT) {
-      if (eventptr->eventity == A) 
-        A_timerinterrupt();
+    else if (eventptr->evtype ==  FROM_LAYER3_BATCH) {
+      for (n=0, q=eventptr; q!=NULL; q=q->batch)
+        n++;
+      pkts2give = malloc(n * sizeof(struct pkt));
+      if (pkts2give == NULL) {
+        printf("memory allocation for packets failed.");
+        exit(EXIT_FAILURE);
+      }
+      for (i=0, q=eventptr; q!=NULL; q=q->batch)
+        pkts2give[i++] = *q->pktptr;
+      ngrobatches++;
+      ngropackets += n;
+      /* deliver the packets to the appropriate entity */
+      if (timing)
+        start = nanoseconds();
+      if (protocol->abi_version >= 4 && protocol->input_batch != NULL)
+        protocol->input_batch(protocolctx, eventptr->eventity, pkts2give, n);
       else
-        B_timerinterrupt();
+        for (i=0; i<n; i++)
+          protocol->input(protocolctx, eventptr->eventity, pkts2give[i]);
+      if (timing)
+        protocolns += nanoseconds() - start;
+      free(pkts2give);
+      for (q=eventptr; q!=NULL; q=next) {
+        next = q->batch;
+        pktbuf_release(q->pktptr->buf);
+        free(q->pktptr);
+        if (q != eventptr)
+          free(q);
+      }
+    }
+    else if (eventptr->evtype ==  TIMER_INTERRUPT) {
+      if (timing)
+        start = nanoseconds();
+      protocol->timerinterrupt(protocolctx, eventptr->eventity);
+      if (timing)
+        protocolns += nanoseconds() - start;
     }
     else  {
       printf("INTERNAL PANIC: unknown event type \n");
@@ -467,12 +1177,66 @@ int main(void)
   }
 
  terminate:
-  printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",time,nsim);
+  printf(" Simulator terminated at time %f\n", simtime);
+  printf(" protocol %s\n after attempting to send %d msgs from layer5\n", protocol->name, nsim);
   printf("number of messages dropped due to full window:  %d \n", window_full);
   printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
   printf("(note: a single acknowledgement may have acknowledged more than one packet - if cumulative acknowledgements are used)\n");
   printf("number of packet resends by A:  %d \n", packets_resent);
+  if (packets_detected > 0 || tail_probes > 0)
+    printf("of those, resent on loss detection before a timeout:  %d, as tail loss probes:  %d \n",
+           packets_detected, tail_probes);
+  if (policy_switches > 0)
+    printf("number of recovery policy switches by A:  %d \n", policy_switches);
+  if (parity_sent > 0)
+    printf("number of parity packets sent by A:  %d, packets repaired by B:  %d \n", parity_sent, packets_repaired);
   printf("number of correct packets received at B:  %d \n", packets_received);
   printf("number of messages delivered to application:  %d \n", messages_delivered);
+  printf("number of bytes delivered to application:  %.0f \n", bytes_delivered);
+  printf("goodput:  %f bytes per time unit\n", simtime > 0.0 ? bytes_delivered / simtime : 0.0);
+  printf("packets sent by A per message accepted:  %f \n", naccepted > 0 ? (double)ndatapackets / naccepted : 0.0);
+  printf("average message delay (layer 5 to layer 5):  %f \n", ncorrect > 0 ? delay / ncorrect : 0.0);
+  if (deadline > 0.0) {
+    printf("messages delivered within the deadline:  %d, %f of those accepted \n",
+           nontime, naccepted > 0 ? (double)nontime / naccepted : 0.0);
+    printf("number of packets abandoned by A (not resent):  %d \n", packets_abandoned);
+  }
+  printf("bytes sent on the wire by A and by B:  %.0f %.0f \n", wirebytes[A], wirebytes[B]);
+  if (bandwidth > 0.0)
+    printf("average queueing delay of A's packets at the link:  %f \n",
+           ndatapackets > 0 ? queuewait[A] / ndatapackets : 0.0);
+  if (corruptmode != CORRUPT_Z) {
+    printf("number of packets corrupted:  %d \n", ncorrupt);
+    printf("number of corrupted messages delivered to application (undetected errors):  %d \n", nundetected);
+    printf("undetected error rate:  %g per corrupted packet\n", ncorrupt > 0 ? (double)nundetected / ncorrupt : 0.0);
+  }
+  if (nstreams > 1) {
+    printf("%-28s%8s", "message delay by stream:", "average");
+    for (i=0; i<NDELAYS; i++) {
+      sprintf(label, i < NDELAYS-1 ? "<%d" : ">=%d", 5 * (1 << (i < NDELAYS-1 ? i : i - 1)));
+      printf(" %6s", label);
+    }
+    printf("\n");
+    for (j=0; j<nstreams; j++) {
+      printf("stream %3d: %6d messages %8.2f", j, streams[j].ncorrect,
+             streams[j].ncorrect > 0 ? streams[j].delay / streams[j].ncorrect : 0.0);
+      for (i=0; i<NDELAYS; i++)
+        printf(" %6d", streams[j].delays[i]);
+      printf("\n");
+    }
+  }
+  if (send_window > 0) {
+    for (sum=0.0, i=0; i<NWINDOWBINS; i++)
+      sum += windowbins[i];
+    printf("average sender window:  %f, by %g time units:", simtime > 0.0 ? sum / simtime : 0.0, windowwidth);
+    for (i=0; i<NWINDOWBINS && i * windowwidth < simtime; i++)
+      printf(" %.1f", windowbins[i] / ((i + 1) * windowwidth < simtime ? windowwidth : simtime - i * windowwidth));
+    printf("\n");
+  }
+  if (gro > 0.0)
+    printf("number of packet batches (gro):  %d, %.2f packets per batch\n",
+           ngrobatches, ngrobatches > 0 ? (double)ngropackets / ngrobatches : 0.0);
+  if (timing)
+    printf("protocol processing time:  %.1f ns per packet\n", ntolayer3 > 0 ? protocolns / ntolayer3 : 0.0);
   return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -6,35 +6,126 @@ extern int packets_resent;       /* count of the number of packets resent  */
 extern int new_ACKs;      /* count of the number of acks correctly received */
 extern int packets_received;  /* count of the packets received by receiver */
 extern int window_full; /* count of the number of messages dropped due to full window */
+extern int parity_sent;   /* count of the FEC parity packets sent */
+extern int packets_repaired;  /* count of the packets the receiver repaired from parity */
+extern int packets_abandoned; /* count of the packets the sender gave up on (deadline=) */
+extern int policy_switches;  /* count of the times a hybrid sender switched policy */
+extern int packets_detected;  /* count of the packets resent on time based loss detection (rack=) */
+extern int tail_probes;       /* count of the tail loss probes sent (rack=) */
+extern int send_window;   /* the sender's window now, if it changes it during the run, else 0 */
 
 #define   A    0
 #define   B    1
 
+/* included for extension to bidirectional communication */
+#define BIDIRECTIONAL 0       /*  0 = A->B  1 =  A<->B */
+
+/* a reference counted buffer of payload bytes.  Data written once into a */
+/* buffer is shared, not copied, by everything that holds a reference:    */
+/* the sender's retransmission buffer, packets in flight, the receiver.   */
+/* A synthetic buffer (payload=synthetic) has no data, only the byte that */
+/* fills it: data is NULL until pktbuf_data() materializes it, and the    */
+/* messages and packets that use it have a NULL data or payload pointer.  */
+/* Every byte of a synthetic buffer is the same, so a NULL payload reads  */
+/* as the first length bytes of pktbuf_data(buf).                         */
+struct pktbuf {
+  int refs;      /* number of references held */
+  int size;      /* bytes of data */
+  char *data;
+  int fill;      /* the byte filling a synthetic buffer, -1 if it is not synthetic */
+};
+
 /* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
 /* 4 (students' code).  It contains the data (characters) to be delivered */
-/* to layer 5 via the students transport level protocol entities.         */
+/* to layer 5 via the students transport level protocol entities.  The    */
+/* data belongs to the caller and is only valid until the call returns,  */
+/* unless a reference to buf is held.                                     */
+/* Messages are msgsize= to maxmsgsize= bytes long (default 20).          */
+/* A connection carries streams= (default 1) streams of messages, which   */
+/* are each delivered in order, but not in order with each other.         */
 struct msg {
-  char data[20];
+  int length;    /* number of bytes of data */
+  char *data;
+  struct pktbuf *buf;   /* the buffer holding data, NULL if it is not in one */
+  int stream;    /* the stream it is sent on, 0 to streams - 1 */
 };
 
+#define MAXSTREAMS 256   /* the most streams= a connection carries */
+
+/* flags of a packet */
+#define PKT_MORE 1   /* more fragments of the same message follow this packet */
+#define PKT_PACKED 2 /* the payload is whole messages, each 2 bytes of length */
+                     /* (least significant first, the top bit set if the      */
+                     /* message is compressed) followed by its data           */
+#define PKT_COMPRESSED 4  /* the message is compressed (compress.h) */
+#define PKT_PARITY 8 /* a FEC parity packet, not a data packet */
+#define PKT_FIRST 16 /* the first packet of a message, or a packed packet */
+#define PKT_FORWARD 32  /* acknum is the sender's window base: the packets */
+                        /* before it will not be sent again */
+#define PKT_CONTROL 64  /* carries no data, only the header's signal */
+#define PKT_SELECTIVE 128  /* hybrid: the sender recovers selectively, or */
+                           /* the ACK is selective                        */
+#define PKT_STREAM 0xFF00  /* the stream of the message the packet carries */
+#define PKT_STREAMSHIFT 8
+#define PKT_PREV 0x7FFF0000  /* with streams=, how many packets back the */
+#define PKT_PREVSHIFT 16     /* stream's packet before this one was sent, */
+                             /* 0 if it was acked before this was sent    */
+
 /* a packet is the data unit passed from layer 4 (students code) to layer */
 /* 3 (teachers code).  Note the pre-defined packet structure, which all   */
-/* students must follow. */
+/* students must follow.  A packet carries at most mtu= (default 20)      */
+/* bytes of payload; like a message's data, the payload belongs to the    */
+/* caller and is only valid until the call returns, unless a reference to */
+/* buf is held.  length is the frame length given by the link layer, so   */
+/* it is never corrupted.  tolayer3() shares the payload of a packet that */
+/* has a buf and copies the payload of one that has not.                  */
 struct pkt {
   int seqnum;
   int acknum;
   int checksum;
-  char payload[20];
+  int flags;     /* PKT_ flags */
+  int length;    /* number of bytes of payload, 0 to mtu */
+  char *payload;
+  struct pktbuf *buf;   /* the buffer holding payload, NULL if it is not in one */
 };
 
 /* send to A or B (int), packet to send */
 extern void tolayer3(int, struct pkt);  
 
-/* deliver to A or B (int), data to deliver */
-extern void tolayer5(int, char[20]); 
+/* send to A or B (int), packets (array) to send, number of packets (int). */
+/* The channel treats them as tolayer3() for each in turn would, and their */
+/* arrivals are added to the event list together, in one pass              */
+extern void tolayer3_batch(int, struct pkt *, int);
+
+/* deliver to A or B (int), message to deliver */
+extern void tolayer5(int, struct msg); 
+
+/* deliver to A or B (int), messages (array) to deliver in order, number */
+/* of messages (int).  The same as calling tolayer5() for each in turn    */
+extern void tolayer5_batch(int, struct msg *, int);
+
+/* a new buffer of size (int) bytes holding one reference */
+extern struct pktbuf *pktbuf_alloc(int);
+
+/* the data of a buffer, materializing a synthetic buffer's data */
+extern char *pktbuf_data(struct pktbuf *);
+
+/* take another reference to a buffer, returns the buffer */
+extern struct pktbuf *pktbuf_hold(struct pktbuf *);
+
+/* drop a reference to a buffer (or NULL), freeing it with the last one */
+extern void pktbuf_release(struct pktbuf *);
 
 /* start timer at A or B (int), increment */
 extern void starttimer(int, double);       
 
 /* stop timer at A or B (int) */
-extern void stoptimer(int);               
+extern void stoptimer(int);
+
+/* value of a name=value command line option (char *), or the default (double) if not given */
+extern double getoption(const char *, double);
+extern int getintoption(const char *, int);
+extern const char *getstringoption(const char *, const char *);
+
+/* the current simulation time */
+extern double gettime(void);               
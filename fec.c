@@ -0,0 +1,404 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "emulator.h"
+#include "checksum.h"
+#include "seqnum.h"
+#include "fec.h"
+
+/* ******************************************************************
+   Arithmetic in GF(2^8) for Reed-Solomon erasure coding.  Elements are
+   bytes, addition is exclusive or, and multiplication uses log and
+   exponent tables of the generator 2 modulo the polynomial
+   x^8 + x^4 + x^3 + x^2 + 1 (0x11D), built on first use.
+**********************************************************************/
+
+#define GF_POLY 0x11D
+
+static unsigned char gfexp[512];   /* doubled so a sum of two logs needs no modulo */
+static int gflog[256];
+static bool gfready = false;
+
+static void makegftables(void)
+{
+  int i, x = 1;
+
+  for (i=0; i<255; i++) {
+    gfexp[i] = gfexp[i + 255] = (unsigned char)x;
+    gflog[x] = i;
+    x <<= 1;
+    if (x & 0x100)
+      x ^= GF_POLY;
+  }
+  gfexp[510] = gfexp[0];
+  gfexp[511] = gfexp[1];
+  gfready = true;
+}
+
+int gf_mul(int a, int b)
+{
+  if (!gfready)
+    makegftables();
+  if (a == 0 || b == 0)
+    return(0);
+  return(gfexp[gflog[a] + gflog[b]]);
+}
+
+int gf_inv(int a)
+{
+  if (!gfready)
+    makegftables();
+  return(gfexp[255 - gflog[a]]);
+}
+
+/* 1 / (x_j + y_i) with x_j = k + j and y_i = i, which are all distinct */
+int fec_coefficient(int k, int j, int i)
+{
+  return(gf_inv((k + j) ^ i));
+}
+
+void fec_accumulate(char *parity, const char *data, int length, int coef)
+{
+  const unsigned char *row;
+  int i;
+
+  if (coef == 0)
+    return;
+  if (coef == 1) {
+    for (i=0; i<length; i++)
+      parity[i] ^= data[i];
+    return;
+  }
+  if (!gfready)
+    makegftables();
+  row = gfexp + gflog[coef];
+  for (i=0; i<length; i++)
+    if (data[i] != 0)
+      parity[i] ^= (char)row[gflog[(unsigned char)data[i]]];
+}
+
+/* Gauss-Jordan elimination alongside an identity matrix */
+bool fec_invert(unsigned char *matrix, int n)
+{
+  static unsigned char inverse[255 * 255];
+  unsigned char t;
+  int row, col, pivot, i, f;
+
+  for (row=0; row<n; row++)
+    for (col=0; col<n; col++)
+      inverse[row * n + col] = row == col;
+  for (col=0; col<n; col++) {
+    for (pivot=col; pivot<n && matrix[pivot * n + col] == 0; pivot++)
+      ;
+    if (pivot == n)
+      return(false);
+    for (i=0; pivot!=col && i<n; i++) {   /* swap the pivot row into place */
+      t = matrix[col * n + i];
+      matrix[col * n + i] = matrix[pivot * n + i];
+      matrix[pivot * n + i] = t;
+      t = inverse[col * n + i];
+      inverse[col * n + i] = inverse[pivot * n + i];
+      inverse[pivot * n + i] = t;
+    }
+    f = gf_inv(matrix[col * n + col]);
+    for (i=0; i<n; i++) {
+      matrix[col * n + i] = (unsigned char)gf_mul(matrix[col * n + i], f);
+      inverse[col * n + i] = (unsigned char)gf_mul(inverse[col * n + i], f);
+    }
+    for (row=0; row<n; row++)
+      if (row != col && (f = matrix[row * n + col]) != 0)
+        for (i=0; i<n; i++) {
+          matrix[row * n + i] ^= (unsigned char)gf_mul(matrix[col * n + i], f);
+          inverse[row * n + i] ^= (unsigned char)gf_mul(inverse[col * n + i], f);
+        }
+  }
+  for (i=0; i<n*n; i++)
+    matrix[i] = inverse[i];
+  return(true);
+}
+
+
+/* ******************************************************************
+   Coding of blocks of packets.  The sender adds each data packet's
+   length, flags and payload, coded as one symbol, to the parity
+   symbols of its block, and sends them as parity packets once the
+   block is complete.  The receiver keeps a block's packets until it
+   has them all, or repairs the missing ones from as many parity
+   packets.
+**********************************************************************/
+
+#define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+
+static void *allocate(size_t size)
+{
+  void *p = malloc(size);
+
+  if (p == NULL) {
+    printf("memory allocation for forward error correction failed.\n");
+    exit(EXIT_FAILURE);
+  }
+  return(p);
+}
+
+void fec_init(struct fec *f, int mode, int k, int m, int mtu, int hdr, int windowsize)
+{
+  int i;
+
+  f->mode = mode;
+  f->k = k;
+  f->m = m;
+  f->mtu = mtu;
+  f->hdr = hdr;
+  f->nparity = 0;
+  f->position = 0;
+  f->repairing = NULL;
+  if (mode == FEC_NONE)
+    return;
+  /* a message's packets can complete a block more than the window holds */
+  f->parity = allocate((windowsize / k + 2) * m * mtu);
+  f->paritybatch = allocate((windowsize / k + 1) * m * sizeof(struct pkt));
+  f->nblocks = windowsize / k + 2;
+  f->blocks = allocate(f->nblocks * sizeof(struct fecblock));
+  for (i=0; i<f->nblocks; i++) {
+    f->blocks[i].used = false;
+    f->blocks[i].packets = allocate((k + m) * sizeof(struct pkt));
+    f->blocks[i].have = allocate(k + m);
+    memset(f->blocks[i].have, 0, k + m);
+  }
+  f->repaired = allocate(k * sizeof(struct pkt));
+  f->symbol = allocate(mtu);
+  f->matrix = allocate(m * m);
+}
+
+/* the coefficient of data packet i in parity packet j of a block */
+static int coef(struct fec *f, int j, int i)
+{
+  return(f->mode == FEC_XOR ? 1 : fec_coefficient(f->k, j, i));
+}
+
+/* the data packets of the block from first: k, but the last block before
+   the sequence numbers wrap holds only those left */
+static int blocksize(struct fec *f, seq_t first)
+{
+  return(SEQMASK - first < (seq_t)f->k - 1 ? (int)(SEQMASK - first) + 1 : f->k);
+}
+
+/* code a data packet's length, flags and payload as one symbol in
+   f->symbol, returning its length.  PKT_SELECTIVE is left out, as a
+   hybrid's resend may change it; a repair takes it from the receiver */
+static int symbol(struct fec *f, struct pkt *packet)
+{
+  char *payload;
+  int i;
+
+  f->symbol[0] = (char)(packet->length & 0xFF);
+  f->symbol[1] = (char)((packet->length >> 8) & 0xFF);
+  f->symbol[2] = (char)(packet->flags & ~PKT_SELECTIVE & 0xFF);
+  f->symbol[3] = (char)((packet->flags >> 8) & 0xFF);
+  if (f->hdr > FECHDR) {
+    /* streams= also uses the high bits */
+    f->symbol[4] = (char)((packet->flags >> 16) & 0xFF);
+    f->symbol[5] = (char)((packet->flags >> 24) & 0xFF);
+  }
+  payload = packet->payload != NULL || packet->length == 0 ? packet->payload : pktbuf_data(packet->buf);
+  for (i=0; i<packet->length; i++)
+    f->symbol[f->hdr + i] = payload[i];
+  return(f->hdr + packet->length);
+}
+
+void fec_encode(struct fec *f, struct pkt *packet)
+{
+  struct pkt *paritypkt;
+  char *parity;
+  int i, j, length;
+
+  /* the block's parity symbols follow those of the blocks queued.  The
+     position is counted rather than taken from the sequence number, as
+     the block before the wrap may be short */
+  parity = f->parity + (f->nparity / f->m) * f->m * f->mtu;
+  i = f->position++;
+  if (i == 0) {
+    memset(parity, 0, f->m * f->mtu);
+    f->paritylength = 0;
+  }
+  length = symbol(f, packet);
+  for (j=0; j<f->m; j++)
+    fec_accumulate(parity + j * f->mtu, f->symbol, length, coef(f, j, i));
+  if (length > f->paritylength)
+    f->paritylength = length;
+  if (i < f->k - 1 && seq_of(packet->seqnum) != SEQMASK)
+    return;
+  f->position = 0;
+
+  /* a parity packet's seqnum is the block's first and its acknum its index */
+  for (j=0; j<f->m; j++) {
+    paritypkt = &f->paritybatch[f->nparity++];
+    paritypkt->seqnum = (int)seq_sub(packet->seqnum, f->k - 1);
+    paritypkt->acknum = j;
+    paritypkt->flags = PKT_PARITY;
+    paritypkt->length = f->paritylength;
+    paritypkt->payload = parity + j * f->mtu;
+    paritypkt->buf = NULL;
+    paritypkt->checksum = ComputeChecksum(*paritypkt);
+  }
+}
+
+void fec_sent(struct fec *f)
+{
+  /* the parity of a block still being sent moves to the front */
+  memmove(f->parity, f->parity + (f->nparity / f->m) * f->m * f->mtu, f->m * f->mtu);
+  f->nparity = 0;
+}
+
+/* drop the packets a block holds */
+static void release(struct fec *f, struct fecblock *b)
+{
+  int i;
+
+  for (i=0; i<f->k+f->m; i++)
+    if (b->have[i] && b->packets[i].buf != NULL)
+      pktbuf_release(b->packets[i].buf);
+  memset(b->have, 0, f->k + f->m);
+  b->ndata = 0;
+  b->nparity = 0;
+}
+
+/* repair the missing data packets of a block from as many of its parity
+   packets into f->repaired, returning the number there or 0 if the
+   block cannot be repaired */
+static int repair(struct fec *f, struct fecblock *b, bool selective, bool discard)
+{
+  struct pkt *packet;
+  int missing[255], rows[255];
+  int nmissing = 0, nrows = 0;
+  int i, j, k, length, symbolsize = 0;
+  char *rhs;
+
+  for (i=0; i<b->size; i++)
+    if (!b->have[i])
+      missing[nmissing++] = i;
+  for (j=0; j<f->m && nrows<nmissing; j++)
+    if (b->have[f->k + j]) {
+      rows[nrows++] = j;
+      if (b->packets[f->k + j].length > symbolsize)
+        symbolsize = b->packets[f->k + j].length;
+    }
+
+  /* each parity symbol less the data symbols present leaves a sum of the
+     missing ones, which the inverse of their coefficients separates */
+  for (i=0; i<nmissing; i++)
+    for (j=0; j<nmissing; j++)
+      f->matrix[i * nmissing + j] = (unsigned char)coef(f, rows[i], missing[j]);
+  if (!fec_invert(f->matrix, nmissing))
+    return(0);
+  rhs = allocate(nmissing * symbolsize);
+  memset(rhs, 0, nmissing * symbolsize);
+  for (j=0; j<nrows; j++) {
+    packet = &b->packets[f->k + rows[j]];
+    fec_accumulate(rhs + j * symbolsize, packet->payload, packet->length, 1);
+    for (i=0; i<b->size; i++)
+      if (b->have[i] && (length = symbol(f, &b->packets[i])) <= symbolsize)
+        fec_accumulate(rhs + j * symbolsize, f->symbol, length, coef(f, rows[j], i));
+  }
+  for (i=0; i<nmissing; i++) {
+    memset(f->symbol, 0, symbolsize);
+    for (j=0; j<nrows; j++)
+      fec_accumulate(f->symbol, rhs + j * symbolsize, symbolsize, f->matrix[i * nmissing + j]);
+    packet = &b->packets[missing[i]];
+    packet->length = (f->symbol[0] & 0xFF) | (f->symbol[1] & 0xFF) << 8;
+    packet->flags = (f->symbol[2] & 0xFF) | (f->symbol[3] & 0xFF) << 8;
+    if (f->hdr > FECHDR)
+      packet->flags |= (f->symbol[4] & 0xFF) << 16 | (f->symbol[5] & 0x7F) << 24;
+    packet->flags &= ~PKT_FORWARD;
+    if (selective)
+      packet->flags |= PKT_SELECTIVE;
+    if (packet->length > symbolsize - f->hdr)
+      break;   /* the parity was corrupted */
+    packet->seqnum = (int)seq_add(b->first, missing[i]);
+    packet->acknum = NOTINUSE;
+    packet->buf = pktbuf_alloc(packet->length);
+    packet->payload = packet->buf->data;
+    for (k=0; k<packet->length; k++)
+      packet->payload[k] = f->symbol[f->hdr + k];
+    packet->checksum = ComputeChecksum(*packet);
+    b->have[missing[i]] = 1;
+    packets_repaired++;
+    if (TRACE > 0)
+      printf("----B: packet %d is repaired from parity\n", packet->seqnum);
+  }
+  free(rhs);
+  if (i < nmissing) {
+    for (i--; i>=0; i--) {
+      pktbuf_release(b->packets[missing[i]].buf);
+      b->have[missing[i]] = 0;
+      packets_repaired--;
+    }
+    return(0);
+  }
+
+  b->done = true;
+  for (i=0, k=0; i<b->size; i++)
+    if (i >= missing[0] && (discard || i == missing[k])) {
+      f->repaired[k++] = b->packets[i];
+      if (k == nmissing && !discard)
+        break;
+    }
+  f->repairing = b;
+  return(k);
+}
+
+int fec_store(struct fec *f, struct pkt *packet, bool selective, bool discard)
+{
+  struct fecblock *b;
+  seq_t first;
+  int i;
+
+  if (packet->flags & PKT_PARITY) {
+    first = seq_of(packet->seqnum);
+    i = f->k + packet->acknum;
+    if (first % f->k != 0 || packet->acknum < 0 || packet->acknum >= f->m ||
+        packet->length < f->hdr || packet->payload == NULL)
+      return(0);
+  }
+  else {
+    i = (int)(seq_of(packet->seqnum) % f->k);
+    first = seq_sub(packet->seqnum, i);
+  }
+
+  /* a later block takes the place of an earlier one */
+  b = &f->blocks[(first / f->k) % f->nblocks];
+  if (!b->used || b->first != first) {
+    if (b->used && seq_lt(first, b->first))
+      return(0);
+    release(f, b);
+    b->used = true;
+    b->done = false;
+    b->first = first;
+    b->size = blocksize(f, first);
+  }
+  if (b->done || b->have[i])
+    return(0);
+
+  b->packets[i] = *packet;
+  if (packet->buf != NULL)
+    pktbuf_hold(packet->buf);
+  b->have[i] = 1;
+  if (i < f->k)
+    b->ndata++;
+  else
+    b->nparity++;
+  if (b->ndata == b->size) {
+    b->done = true;
+    release(f, b);
+  }
+  else if (b->ndata + b->nparity >= b->size)
+    return(repair(f, b, selective, discard));
+  return(0);
+}
+
+void fec_received(struct fec *f)
+{
+  release(f, f->repairing);
+  f->repairing = NULL;
+}
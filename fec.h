@@ -0,0 +1,91 @@
+/* forward error correction shared by the protocols: arithmetic in GF(2^8) */
+/* for the erasure codes of fec=, and the coding of blocks of packets      */
+/* with them.  Include emulator.h and seqnum.h first                       */
+
+#include <stdbool.h>
+
+/* the product and inverse of field elements (int, 0 to 255) */
+extern int gf_mul(int, int);
+extern int gf_inv(int);
+
+/* coefficient of data symbol i (int) in parity symbol j (int) of a block */
+/* of k (int) data symbols: a Cauchy matrix, any square part of which is  */
+/* invertible, so any k of the k + m symbols recover the block            */
+extern int fec_coefficient(int, int, int);
+
+/* add coef (int) times length (int) bytes of data to parity (char *) */
+extern void fec_accumulate(char *, const char *, int, int);
+
+/* invert the n x n (int, at most 255) matrix of field elements     */
+/* (unsigned char *, row by row) in place, false if it is singular */
+extern bool fec_invert(unsigned char *, int);
+
+/* erasure codes, chosen with the fec= option */
+#define FEC_NONE  0
+#define FEC_XOR   1   /* one parity packet per block, the exclusive or of its packets */
+#define FEC_RS    2   /* m Reed-Solomon parity packets per block */
+
+#define FECHDR 4   /* bytes of a data packet's length and flags coded with its payload */
+
+struct pkt;
+
+/* a block of data packets being received with their parity packets */
+struct fecblock {
+  seq_t first;             /* the sequence number of its first data packet */
+  int size;                /* its data packets: k, less for the last before the sequence numbers wrap */
+  bool used;               /* first is set */
+  bool done;               /* every data packet was received or repaired */
+  struct pkt *packets;     /* k data packets then m parity packets, held */
+  char *have;              /* which of them have arrived */
+  int ndata;               /* the number of data packets that have */
+  int nparity;             /* the number of parity packets that have */
+};
+
+/* the forward error correction of a connection: the parity of the */
+/* blocks the sender sends, and the blocks the receiver receives   */
+struct fec {
+  int mode;                /* FEC_ mode */
+  int k;                   /* data packets per block */
+  int m;                   /* parity packets per block */
+  int mtu;                 /* the largest payload of a packet */
+  int hdr;                 /* bytes of header coded in a symbol, FECHDR or more with streams= */
+  char *symbol;            /* a packet's header and payload coded together, mtu bytes */
+  unsigned char *matrix;   /* m x m coefficients of a repair */
+  char *parity;            /* sender: parity symbols, m of mtu bytes for each block in paritybatch
+                              and the block being sent */
+  int paritylength;        /* sender: bytes of the block being sent's parity symbols in use */
+  int position;            /* sender: the position in its block of the next data packet */
+  struct pkt *paritybatch; /* sender: parity packets of the blocks completed, waiting to be sent */
+  int nparity;             /* sender: the number of them */
+  struct fecblock *blocks; /* receiver: the blocks being received, by block number modulo nblocks */
+  int nblocks;
+  struct pkt *repaired;    /* receiver: the packets of a repaired block to be received */
+  struct fecblock *repairing;  /* receiver: that block, released once they are */
+};
+
+/* start forward error correction of a mode (int), with k (int) data    */
+/* and m (int) parity packets a block, an mtu (int), hdr (int) bytes of */
+/* header in a symbol, for a window of (int) packets                    */
+extern void fec_init(struct fec *, int, int, int, int, int, int);
+
+/* sender: add a data packet sent for the first time to the parity of */
+/* its block, and when it completes the block queue the block's       */
+/* parity packets in paritybatch.  Blocks are k consecutive sequence  */
+/* numbers from 0; the last before the sequence numbers wrap is cut   */
+/* short there unless k is a power of two                             */
+extern void fec_encode(struct fec *, struct pkt *);
+
+/* sender: the parity packets queued have been sent */
+extern void fec_sent(struct fec *);
+
+/* receiver: keep an uncorrupted data or parity packet with its block   */
+/* until the block is complete, repairing the block when enough packets */
+/* have arrived.  Returns the number of packets in repaired for the     */
+/* receiver to receive, then call fec_received(), else 0.  Repaired     */
+/* packets are flagged PKT_SELECTIVE if selective (bool).  A receiver   */
+/* that discards (bool) packets out of order also receives again the    */
+/* packets of the block that followed the first one missing             */
+extern int fec_store(struct fec *, struct pkt *, bool, bool);
+
+/* receiver: the repaired packets have been received */
+extern void fec_received(struct fec *);
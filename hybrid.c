@@ -0,0 +1,44 @@
+#include <stddef.h>
+#include "emulator.h"
+#include "protocol.h"
+#include "arq.h"
+#include "seqnum.h"
+
+/* ******************************************************************
+   Hybrid Go Back N / Selective Repeat protocol.
+
+   Modifications:
+   - the hybrid is a pair of policies of the sliding window engine in
+   arq.c, which switches between them during the connection
+**********************************************************************/
+
+/* the Selective Repeat policy the hybrid switches to while loss is high */
+static const struct arq_policy hybrid_lossy_policy = {
+  "hybrid", ACK_SELECTIVE, RETRANSMIT_OLDEST, RECEIVE_BUFFER, (int)(SEQHALF / 2), NULL
+};
+
+/* Hybrid: Go Back N while the link is clean, whose cumulative ACKs are
+   cheaper, and Selective Repeat while the sender sees more than
+   hybridloss= (default 0.05) timeouts per packet sent, until they fall
+   below half of that.  Data packets tell the receiver which it is
+   (PKT_SELECTIVE), and ACKs which kind they are.  The window must suit
+   both, so it is at most a quarter of the sequence space.
+*/
+const struct arq_policy hybrid_policy = {
+  "hybrid", ACK_CUMULATIVE, RETRANSMIT_WINDOW, RECEIVE_DISCARD, (int)(SEQHALF / 2), &hybrid_lossy_policy
+};
+
+static void *hybrid_init(void)
+{
+  return(arq_create(&hybrid_policy));
+}
+
+const struct protocol hybrid_protocol = {
+  PROTOCOL_ABI_VERSION, "hybrid", hybrid_init, arq_output, arq_input, arq_timerinterrupt,
+  arq_input_batch
+};
+
+#ifdef PLUGIN
+/* the entry point the emulator looks up when this is built as a plugin */
+const struct protocol *protocol_plugin = &hybrid_protocol;
+#endif
@@ -0,0 +1,51 @@
+#!/bin/sh
+# Loss benchmark: goodput, message delay, resends, bytes on the wire and
+# recovery policy switches of Go Back N, Go Back N with a buffering
+# receiver, Selective Repeat and the hybrid that switches between them,
+# over a sweep of loss probabilities.  With fec= the parity packets sent
+# and the packets repaired from them are reported next to the resends.
+# Then each cc= with msgsize=60, 3 packets at the default mtu=: more
+# than the first congestion window, yet they must get through.
+#
+# usage: ./lossbench.sh [emulator [messages [interval [name=value ...]]]]
+#   e.g. ./lossbench.sh ./emulator 2000 10 windowsize=8 gro=2
+#        ./lossbench.sh ./emulator 2000 10 fec=rs mtu=24
+
+emulator=${1:-./emulator}
+messages=${2:-2000}
+interval=${3:-10}
+[ $# -gt 3 ] && shift 3 || set --
+options="$*"
+
+printf "%-6s %-10s %10s %10s %8s %8s %8s %10s %8s\n" loss protocol goodput delay resends parity repaired wirebytes switches
+run() {
+  loss=$1
+  label=$2
+  shift 2
+  # messages, loss and no corruption (in both directions, asked only if
+  # there is loss), arrivals every interval, TRACE 0
+  if [ "$loss" = 0.0 ]; then
+    printf "%d\n0.0\n0.0\n%s\n0\n" "$messages" "$interval"
+  else
+    printf "%d\n%s\n0.0\n2\n%s\n0\n" "$messages" "$loss" "$interval"
+  fi |
+    "$emulator" $options "$@" |
+    awk -v l="$loss" -v p="$label" '
+      /^goodput/ { goodput = $2 }
+      /average message delay/ { delay = $NF }
+      /packet resends by A/ { resends = $NF }
+      /parity packets sent/ { parity = $8; sub(/,/, "", parity); repaired = $NF }
+      /bytes sent on the wire/ { wirebytes = $(NF-1) + $NF }
+      /policy switches/ { switches = $NF }
+      END { printf "%-6s %-10s %10.3f %10.2f %8d %8d %8d %10d %8d\n", l, p, goodput, delay, resends, parity, repaired, wirebytes, switches }'
+}
+for loss in 0.0 0.01 0.02 0.05 0.1 0.2 0.3; do
+  for protocol in gbn gbnb sr hybrid; do
+    run $loss $protocol protocol=$protocol
+  done
+done
+for cc in aimd cubic model; do
+  for protocol in gbn sr; do
+    run 0.1 $protocol/$cc protocol=$protocol cc=$cc msgsize=60 windowsize=8
+  done
+done
@@ -0,0 +1,79 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include "emulator.h"
+#include "nagle.h"
+
+/* ******************************************************************
+   Nagle packing.  Small messages wait in one packet buffer while
+   earlier packets are in flight, for at most the hold time; the
+   sender decides when that is and sends the packet.
+**********************************************************************/
+
+void nagle_init(struct nagle *n, double hold, int size)
+{
+  n->hold = hold;
+  n->size = size;
+  n->pending = NULL;
+  n->length = 0;
+  n->since = 0.0;
+  n->stream = 0;
+}
+
+bool nagle_packs(const struct nagle *n, int length)
+{
+  return(n->hold > 0.0 && length + 2 <= n->size && length <= 0x7FFF);
+}
+
+bool nagle_full(const struct nagle *n, int length, int stream)
+{
+  return(n->pending != NULL && (n->length + 2 + length > n->size || n->stream != stream));
+}
+
+void nagle_pack(struct nagle *n, const char *data, int length, bool compressed, int stream, double now)
+{
+  int i;
+
+  if (n->pending == NULL) {
+    n->pending = pktbuf_alloc(n->size);
+    n->length = 0;
+    n->since = now;
+    n->stream = stream;
+  }
+  n->pending->data[n->length++] = (char)(length & 0xFF);
+  n->pending->data[n->length++] = (char)((length >> 8) | (compressed ? 0x80 : 0));
+  for (i=0; i<length; i++)
+    n->pending->data[n->length++] = data[i];
+}
+
+/* event times are floats, so the hold is compared at float precision */
+bool nagle_due(const struct nagle *n, double now)
+{
+  return(n->pending != NULL && (float)now >= (float)(n->since + n->hold));
+}
+
+double nagle_deadline(const struct nagle *n)
+{
+  return(n->pending != NULL ? n->since + n->hold : -1.0);
+}
+
+struct pktbuf *nagle_take(struct nagle *n)
+{
+  struct pktbuf *buf = n->pending;
+
+  n->pending = NULL;
+  return(buf);
+}
+
+int nagle_unpack(const char *data, int length, int *offset, bool *compressed)
+{
+  int n;
+
+  if (*offset + 2 > length)
+    return(-1);
+  n = (data[*offset] & 0xFF) | (data[*offset + 1] & 0x7F) << 8;
+  *compressed = (data[*offset + 1] & 0x80) != 0;
+  *offset += 2;
+  if (n > length - *offset)
+    return(-1);
+  return(n);
+}
@@ -0,0 +1,48 @@
+/* Nagle packing of small messages into one packet (nagle=).  A packet */
+/* of packed messages holds each as 2 bytes of length, least           */
+/* significant first and the top bit set if it is compressed, then its */
+/* data.  Include emulator.h first                                     */
+
+#include <stdbool.h>
+
+/* the messages a sender has packed for its next packet */
+struct nagle {
+  double hold;             /* the longest a message waits to be packed with others, 0 to send each alone */
+  int size;                /* the bytes a packet of them holds */
+  struct pktbuf *pending;  /* the messages packed, or NULL */
+  int length;              /* bytes of it used */
+  double since;            /* time the first of them was packed */
+  int stream;              /* the stream they are on */
+};
+
+/* start packing for a hold time (double) into packets of size (int) bytes */
+extern void nagle_init(struct nagle *, double, int);
+
+/* whether a message of length (int) bytes is packed rather than sent alone */
+extern bool nagle_packs(const struct nagle *, int);
+
+/* whether a message of length (int) bytes on a stream (int) does not */
+/* fit with the messages packed, which must be sent first             */
+extern bool nagle_full(const struct nagle *, int, int);
+
+/* pack a message's data (char *) of length (int) bytes, compressed   */
+/* (bool), on a stream (int) at a time (double), starting a packet if */
+/* none is pending                                                     */
+extern void nagle_pack(struct nagle *, const char *, int, bool, int, double);
+
+/* whether the messages packed have been held for the hold time at a time (double) */
+extern bool nagle_due(const struct nagle *, double);
+
+/* the time the messages packed have been held for the hold time, */
+/* negative if there are none                                     */
+extern double nagle_deadline(const struct nagle *);
+
+/* the messages packed, which the caller releases; none are pending after */
+extern struct pktbuf *nagle_take(struct nagle *);
+
+/* the length of the next message packed in a payload (char *) of     */
+/* length (int) bytes at the offset (int *), which it moves past the  */
+/* message's length, setting whether it is compressed (bool *).       */
+/* Negative after the last, or at one that runs past the end (the     */
+/* packet was corrupted)                                              */
+extern int nagle_unpack(const char *, int, int *, bool *);
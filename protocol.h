@@ -0,0 +1,55 @@
+/* Protocol plugin interface.
+
+   A protocol is a struct protocol of callbacks that the emulator calls
+   for entity A and B events.  Protocols are either built into the
+   emulator (gbn, gbnb, sr, srt, abp, hybrid) or loaded at runtime from
+   a shared object named by the protocol= option, e.g.
+   "protocol=./myarq.so".  A plugin exports a pointer to its struct
+   protocol as
+
+     const struct protocol *protocol_plugin = &myarq_protocol;
+
+   and is built against the emulator's student-callable routines
+   (tolayer3(), starttimer(), getoption() ...), which the emulator
+   exports to it:
+
+     gcc -Wall -ansi -pedantic -rdynamic -o emulator emulator.c arq.c \
+         gbn.c sr.c abp.c hybrid.c checksum.c compress.c fec.c nagle.c \
+         stream.c deadline.c rack.c cc.c bitmap.c ring.c -ldl
+     gcc -Wall -ansi -pedantic -shared -fPIC -Wl,-Bsymbolic -DPLUGIN \
+         -o gbn.so gbn.c arq.c checksum.c compress.c fec.c nagle.c \
+         stream.c deadline.c rack.c cc.c bitmap.c ring.c
+
+   Later versions of the interface only append callbacks to struct
+   protocol; the emulator uses the callbacks of the version a plugin
+   declares, so plugins built against older versions keep working.
+   The exceptions are versions 2, which made messages and packets
+   variable length, 3, which added their buffer handles, and 5, which
+   added the stream of a message (struct msg and struct pkt in
+   emulator.h): older plugins must be rebuilt. */
+
+#define PROTOCOL_ABI_VERSION 5
+#define PROTOCOL_ABI_OLDEST  5   /* the oldest version the emulator can load */
+
+struct protocol {
+  int abi_version;   /* the PROTOCOL_ABI_VERSION the protocol was built against */
+  const char *name;  /* name printed in the simulation summary */
+
+  /* set up entities A and B.  Returns the context passed to the other callbacks */
+  void *(*init)(void);
+
+  /* context, A or B (int), message from layer 5 to send to the other side */
+  void (*output)(void *, int, struct msg);
+
+  /* context, A or B (int), packet arriving from layer 3 */
+  void (*input)(void *, int, struct pkt);
+
+  /* context, A or B (int) whose timer went off */
+  void (*timerinterrupt)(void *, int);
+
+  /* version 4: context, A or B (int), packets (array) that arrived
+     together, number of packets (int).  With gro= the emulator passes
+     the arrivals it coalesces here rather than to input(); if NULL it
+     calls input() for each packet in turn */
+  void (*input_batch)(void *, int, struct pkt *, int);
+};
@@ -0,0 +1,56 @@
+#include <stdbool.h>
+#include "rack.h"
+
+void rack_init(struct rack *r, double window)
+{
+  r->window = window;
+  r->xmit = 0.0;
+  r->probe = -1.0;
+  r->probeslot = -1;
+  r->probed = false;
+}
+
+/* a resent packet's ACK may be for its first copy, so only a probe's
+   counts: nothing sent before it is in flight either way */
+void rack_ack(struct rack *r, int slot, bool selective, double sent, bool resent)
+{
+  if (selective && sent > r->xmit && (!resent || slot == r->probeslot))
+    r->xmit = sent;
+  if (slot == r->probeslot)
+    r->probeslot = -1;
+}
+
+/* in order, its ACK would have come before the latest one's */
+bool rack_lost(const struct rack *r, double sent)
+{
+  return(sent + r->window < r->xmit);
+}
+
+void rack_arm(struct rack *r, bool inflight, double now, double srtt)
+{
+  r->probe = -1.0;
+  if (inflight && !r->probed)
+    r->probe = now + TLP_GAIN * srtt;
+}
+
+/* event times are floats, so the probe is compared at float precision */
+bool rack_due(struct rack *r, double now)
+{
+  if (r->probe < 0.0 || (float)r->probe > (float)now)
+    return(false);
+  r->probe = -1.0;
+  r->probed = true;
+  return(true);
+}
+
+void rack_timeout(struct rack *r)
+{
+  r->probe = -1.0;
+  r->probed = true;
+}
+
+void rack_reuse(struct rack *r, int slot)
+{
+  if (slot == r->probeslot)
+    r->probeslot = -1;
+}
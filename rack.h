@@ -0,0 +1,42 @@
+/* Time based loss detection and tail loss probes (rack=), for senders  */
+/* with selective ACKs.  A packet is lost once one sent more than the   */
+/* reordering window after it is acked, and a probe resends the newest  */
+/* packet in flight when no ACK comes for a while, so that its ACK      */
+/* shows which packets before it were lost                              */
+
+#include <stdbool.h>
+
+#define TLP_GAIN 2.0   /* the tail loss probe's wait over the smoothed RTT */
+
+/* the state of a sender's loss detection */
+struct rack {
+  double window;           /* the reordering window, 0 for none */
+  double xmit;             /* the latest a packet selectively acked was sent */
+  double probe;            /* the time of the tail loss probe, negative if none */
+  int probeslot;           /* the ring slot of the last probe sent, -1 once acked or reused */
+  bool probed;             /* a probe or timeout has had no ACK since */
+};
+
+/* start loss detection with a reordering window (double), 0 for none */
+extern void rack_init(struct rack *, double);
+
+/* the packet in a slot (int), sent at a time (double) and resent    */
+/* (bool) or not, was acked, selectively (bool) or not               */
+extern void rack_ack(struct rack *, int, bool, double, bool);
+
+/* whether a packet sent at a time (double) and not acked is lost */
+extern bool rack_lost(const struct rack *, double);
+
+/* run the probe to TLP_GAIN smoothed RTTs (double) from now (double)  */
+/* while packets are in flight (bool), unless the last probe or        */
+/* timeout has had no ACK                                              */
+extern void rack_arm(struct rack *, bool, double, double);
+
+/* whether the probe is due at a time (double), which disarms it */
+extern bool rack_due(struct rack *, double);
+
+/* A's retransmission timer went off, which disarms the probe */
+extern void rack_timeout(struct rack *);
+
+/* a slot (int) is reused for a new packet */
+extern void rack_reuse(struct rack *, int);
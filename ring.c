@@ -0,0 +1,16 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "ring.h"
+
+int ring_size(int nslots)
+{
+  int size = 1;
+
+  if (nslots > RING_MAXSIZE) {
+    printf("a ring of %d slots is larger than the largest of %d\n", nslots, RING_MAXSIZE);
+    exit(EXIT_FAILURE);
+  }
+  while (size < nslots)
+    size <<= 1;
+  return(size);
+}
@@ -0,0 +1,14 @@
+/* Window buffers are rings of slots indexed by position & (size - 1).  The */
+/* ring size is decoupled from the window size: it is the window size       */
+/* rounded up to a power of two, so advancing an index is a mask rather     */
+/* than a division whatever window size is configured.  The window count,   */
+/* not the ring size, limits the number of packets outstanding.             */
+
+#define RING_MAXSIZE (1 << 30)   /* the largest ring: the largest power of two an int holds */
+
+/* the ring size, a power of two, for a window of (int) slots, at most
+   RING_MAXSIZE */
+extern int ring_size(int);
+
+/* slot i + n of a ring with index mask (size - 1) */
+#define ring_slot(i, n, mask) (((i) + (n)) & (mask))
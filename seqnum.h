@@ -0,0 +1,27 @@
+/* Sequence numbers.  Sequence numbers count packets in a 32 bit space that */
+/* wraps back to 0, and are compared with serial number arithmetic (RFC     */
+/* 1982): a is before b if b is less than 2^31 ahead of a, so any window    */
+/* smaller than 2^31 packets is ordered correctly across the wrap without   */
+/* special cases.  In struct pkt they are carried in the int seqnum and     */
+/* acknum fields; the macros below accept either ints or seq_t.             */
+
+typedef unsigned long seq_t;
+
+#define SEQMASK 0xFFFFFFFFUL   /* sequence numbers are 32 bits */
+#define SEQHALF 0x80000000UL   /* half the sequence space: the largest usable window */
+
+/* the sequence number an int header field carries */
+#define seq_of(n) ((seq_t)(n) & SEQMASK)
+
+/* sequence number n after s */
+#define seq_add(s, n) (((seq_t)(s) + (seq_t)(n)) & SEQMASK)
+
+/* sequence number n before s */
+#define seq_sub(s, n) (((seq_t)(s) - (seq_t)(n)) & SEQMASK)
+
+/* distance from sequence number b forward to sequence number a */
+#define seq_diff(a, b) (((seq_t)(a) - (seq_t)(b)) & SEQMASK)
+
+/* serial number comparisons */
+#define seq_lt(a, b)  (seq_diff(b, a) != 0 && seq_diff(b, a) < SEQHALF)
+#define seq_leq(a, b) (seq_diff(b, a) < SEQHALF)
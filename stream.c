@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "emulator.h"
+#include "seqnum.h"
+#include "stream.h"
+
+/* ******************************************************************
+   Streams.  The sender points each packet back to its stream's packet
+   before while that is still unacked, so a buffering receiver can
+   deliver it once that one is delivered.  The receiver reassembles
+   each stream's messages apart.
+**********************************************************************/
+
+int stream_prev(seq_t *last, seq_t next, seq_t base)
+{
+  seq_t prev = *last;
+
+  *last = next;
+  if (seq_leq(base, prev) && seq_lt(prev, next))
+    return((int)seq_diff(next, prev));
+  return(0);
+}
+
+void stream_init(struct stream *m, int size)
+{
+  m->messagesize = size;
+  m->message = malloc(size);
+  if (m->message == NULL) {
+    printf("memory allocation for stream failed.\n");
+    exit(EXIT_FAILURE);
+  }
+  m->messagebuf = NULL;
+  m->messagelength = 0;
+  m->last = 0;
+}
+
+/* the packets of a synthetic message are only counted, and the message
+   is delivered as their buffer */
+void stream_append(struct stream *m, struct pkt *packet)
+{
+  char *data;
+  int i;
+
+  if (packet->payload == NULL && packet->length > 0 &&
+      (m->messagelength == 0 || m->messagebuf == packet->buf)) {
+    if (m->messagebuf == NULL)
+      m->messagebuf = pktbuf_hold(packet->buf);
+    m->messagelength += packet->length;
+    return;
+  }
+
+  if (m->messagelength + packet->length > m->messagesize) {
+    while (m->messagelength + packet->length > m->messagesize)
+      m->messagesize *= 2;
+    m->message = realloc(m->message, m->messagesize);
+    if (m->message == NULL) {
+      printf("memory allocation for message failed.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  /* a synthetic start of the message is materialized when other data follows it */
+  if (m->messagebuf != NULL) {
+    data = pktbuf_data(m->messagebuf);
+    for (i=0; i<m->messagelength; i++)
+      m->message[i] = data[i];
+    pktbuf_release(m->messagebuf);
+    m->messagebuf = NULL;
+  }
+  data = packet->payload != NULL ? packet->payload : pktbuf_data(packet->buf);
+  for (i=0; i<packet->length; i++)
+    m->message[m->messagelength + i] = data[i];
+  m->messagelength += packet->length;
+}
+
+void stream_done(struct stream *m)
+{
+  pktbuf_release(m->messagebuf);
+  m->messagebuf = NULL;
+  m->messagelength = 0;
+}
+
+void stream_drop(struct stream *m)
+{
+  if (m->messagelength > 0 && TRACE > 0)
+    printf("----B: dropping the part of a message the sender abandoned\n");
+  stream_done(m);
+}
@@ -0,0 +1,31 @@
+/* Streams of messages multiplexed over one window (streams=).  Each   */
+/* packet carries its stream and how far back the stream's previous    */
+/* packet was sent, and each stream reassembles its own messages.      */
+/* Include emulator.h and seqnum.h first                               */
+
+/* a stream's message being reassembled by the receiver */
+struct stream {
+  char *message;           /* the message being reassembled */
+  struct pktbuf *messagebuf;  /* the synthetic buffer of a message reassembled so far
+                                 only from synthetic packets, else NULL */
+  int messagelength;       /* bytes of it received so far */
+  int messagesize;         /* bytes allocated for it */
+  seq_t last;              /* the sequence number of its last packet delivered */
+};
+
+/* how far back the packet before next (seq_t) on a stream, whose last */
+/* packet sent is last (seq_t *), was sent, or 0 if it was not sent    */
+/* from base (seq_t) on.  next becomes the stream's last               */
+extern int stream_prev(seq_t *, seq_t, seq_t);
+
+/* start reassembling messages in a buffer of size (int) bytes */
+extern void stream_init(struct stream *, int);
+
+/* add a packet's payload to the message being reassembled */
+extern void stream_append(struct stream *, struct pkt *);
+
+/* the message reassembled has been delivered */
+extern void stream_done(struct stream *);
+
+/* drop the part of the message reassembled so far */
+extern void stream_drop(struct stream *);
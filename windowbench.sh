@@ -0,0 +1,47 @@
+#!/bin/sh
+# Window size benchmark: goodput, message delay and resends with each
+# fixed windowsize of a sweep, unpaced and then paced (pace=auto, which
+# matters with bandwidth=), then with the window tuned at runtime to
+# the measured bandwidth-delay product (cc=bdp), bounded by the largest
+# windowsize of the sweep, unpaced, paced, and with msgsize=60: messages
+# of 3 packets at the default mtu=, more than its first window.
+#
+# usage: ./windowbench.sh [emulator [messages [lossprob [interval [name=value ...]]]]]
+#   e.g. ./windowbench.sh ./emulator 2000 0.1 2 protocol=gbn bandwidth=8
+
+emulator=${1:-./emulator}
+messages=${2:-2000}
+lossprob=${3:-0.1}
+interval=${4:-2}
+[ $# -gt 4 ] && shift 4 || set --
+options="$*"
+windows="1 2 4 8 16 32 64"
+largest=64
+
+printf "%-32s %10s %10s %8s %8s\n" window goodput delay resends average
+run() {
+  # messages, lossprob and no corruption (in both directions, asked only
+  # if there is loss), arrivals every interval, TRACE 0
+  if [ "$lossprob" = 0 ] || [ "$lossprob" = 0.0 ]; then
+    printf "%d\n0.0\n0.0\n%s\n0\n" "$messages" "$interval"
+  else
+    printf "%d\n%s\n0.0\n2\n%s\n0\n" "$messages" "$lossprob" "$interval"
+  fi |
+    "$emulator" $options "$@" |
+    awk -v w="$*" '
+      /^goodput/ { goodput = $2 }
+      /average message delay/ { delay = $NF }
+      /packet resends by A/ { resends = $NF }
+      /average sender window/ { average = $4; sub(/,/, "", average) }
+      END { if (average == "") average = "-"
+            printf "%-32s %10.3f %10.2f %8d %8s\n", w, goodput, delay, resends, average }'
+}
+for window in $windows; do
+  run windowsize=$window
+done
+for window in $windows; do
+  run windowsize=$window pace=auto
+done
+run windowsize=$largest cc=bdp
+run windowsize=$largest cc=bdp pace=auto
+run windowsize=$largest cc=bdp msgsize=60